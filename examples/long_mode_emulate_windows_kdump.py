@@ -152,8 +152,6 @@ def exception_cb(
 
 
 def before_execution_cb(sess: bochscpu.Session, cpu_id: int, _: int):
-    global perf
-    perf.executed_instruction += 1
     state = sess.cpu.state
     insn = disass(state, state.rip)
     logging.debug(
@@ -161,17 +159,9 @@ def before_execution_cb(sess: bochscpu.Session, cpu_id: int, _: int):
     )
 
 
-def after_execution_cb(sess: bochscpu.Session, cpu_id: int, _: int):
-    global emulation_end_address
-
-    if not emulation_end_address:
-        return
-
-    if emulation_end_address == sess.cpu.state.rip:
-        logging.info(
-            f"[CPU#{cpu_id}] Reaching end address @ {emulation_end_address}, ending emulation"
-        )
-        sess.stop()
+def breakpoint_cb(sess: bochscpu.Session, rip: int):
+    logging.info(f"Reaching end address @ {rip:#x}, ending emulation")
+    sess.stop()
 
 
 def resolve_function(symbol: str) -> int:
@@ -342,7 +332,10 @@ def emulate(dmp_path: pathlib.Path):
     hook = bochscpu.Hook()
     hook.exception = exception_cb
     hook.before_execution = before_execution_cb
-    hook.after_execution = after_execution_cb
+
+    if emulation_end_address:
+        session.add_breakpoint(emulation_end_address)
+        session.breakpoint_handler = breakpoint_cb
 
     logging.debug("Initial register state")
     bochscpu.utils.dump_registers(session.cpu.state, True)
@@ -350,7 +343,7 @@ def emulate(dmp_path: pathlib.Path):
     logging.debug("Let's go baby!")
 
     perf.start_time_ns = int(time.time_ns())
-    session.run(
+    perf.executed_instruction = session.run(
         [
             hook,
         ]
@@ -368,8 +361,7 @@ def emulate(dmp_path: pathlib.Path):
 
 def clean():
     logging.debug("Cleanup")
-    for hva in hvas:
-        bochscpu.memory.release_host_page(hva)
+    bochscpu.memory.release_host_pages(hvas)
 
 
 if __name__ == "__main__":
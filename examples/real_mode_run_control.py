@@ -0,0 +1,185 @@
+#
+# Example: Control the execution of a real mode program: instruction limit, breakpoints
+# and resume, native port devices, and snapshot/restore of the guest
+# Requires: keystone-engine, capstone
+#
+
+import logging
+import sys
+
+import capstone
+import keystone
+
+import bochscpu
+import bochscpu.cpu
+import bochscpu.memory
+import bochscpu.utils
+
+PAGE_SIZE = bochscpu.utils.PAGE_SIZE
+
+CODE_GPA = 0x0000_1000
+DATA_GPA = 0x0000_2000
+STACK_GPA = 0x0000_8000
+
+COUNTER_PORT = 0x40
+LATCH_PORT = 0x80
+ITERATIONS = 10
+
+#
+# Read a value from the counter device, store it and echo it to the latch device,
+# `ITERATIONS` times
+#
+PROGRAM_ASM = f"""
+_start:
+    xor cx, cx
+
+loop:
+    in ax, {COUNTER_PORT:#x}
+    mov [0x10], ax
+    out {LATCH_PORT:#x}, al
+    inc cx
+    cmp cx, {ITERATIONS}
+    jne loop
+
+    hlt
+"""
+
+
+def missing_page_cb(gpa: int):
+    raise Exception(f"missing_page_cb({gpa=:#x})")
+
+
+def hlt_cb(sess: bochscpu.Session, cpu_id: int):
+    logging.debug(f"[CPU#{cpu_id}] hlt at {sess.cpu.rip:#x}")
+    sess.stop()
+
+
+def segment(base: int, limit: int, selector: int, code: bool) -> bochscpu.Segment:
+    seg = bochscpu.Segment()
+    seg.present = True
+    seg.base = base
+    seg.limit = limit
+    seg.selector = selector
+    attr = bochscpu.cpu.SegmentFlags()
+    attr.P = True
+    attr.S = True
+    attr.E = code
+    attr.R = code
+    attr.W = not code
+    attr.DPL = 0
+    seg.attr = int(attr)
+    return seg
+
+
+def emulate(code: bytes, out_ip: int):
+    #
+    # Map the code, data and stack pages
+    #
+    hvas = []
+    for gpa in (CODE_GPA, DATA_GPA, STACK_GPA):
+        hva = bochscpu.memory.allocate_host_page()
+        bochscpu.memory.page_insert(gpa, hva)
+        hvas.append(hva)
+    bochscpu.memory.phy_write(CODE_GPA, bytearray(code.ljust(PAGE_SIZE, b"\xcc")))
+
+    sess = bochscpu.Session()
+    sess.missing_page_handler = missing_page_cb
+
+    state = bochscpu.State()
+    bochscpu.cpu.set_real_mode(state)
+    state.cs = segment(CODE_GPA, PAGE_SIZE, 6 << 3, True)
+    state.ds = segment(DATA_GPA, PAGE_SIZE, 10 << 3, False)
+    state.ss = segment(STACK_GPA, PAGE_SIZE, 8 << 3, False)
+    state.rsp = 0x0800
+    state.rip = 0x0000
+    sess.cpu.state = state
+
+    #
+    # The `in` and `out` instructions are served natively by the devices, without
+    # calling Python
+    #
+    counter = bochscpu.CounterPort(0x41, 1)
+    latch = bochscpu.LatchPort()
+    sess.attach_port_device(COUNTER_PORT, COUNTER_PORT, counter)
+    sess.attach_port_device(LATCH_PORT, LATCH_PORT, latch)
+
+    hook = bochscpu.Hook()
+    hook.hlt = hlt_cb
+
+    #
+    # Capture the initial state of the guest, restored between the runs
+    #
+    snapshot = sess.snapshot()
+    logging.info(f"Took a snapshot of {len(snapshot.pages)} pages")
+
+    #
+    # 1. Instruction limit: exactly `max_instructions` instructions are executed
+    #
+    sess.run([hook], max_instructions=3)
+    assert sess.stop_reason == bochscpu.StopReason.InstructionLimit, sess.stop_reason
+    assert sess.executed_instructions == 3, sess.executed_instructions
+    logging.info(
+        f"Stopped after {sess.executed_instructions} instructions at {sess.cpu.rip:#x}"
+    )
+
+    restored = sess.restore(snapshot)
+    assert sess.cpu.rip == 0, f"{sess.cpu.rip=:#x}"
+    logging.info(f"Restored {restored} pages")
+
+    #
+    # 2. Breakpoints: the run stops before the `out`, and resuming from there doesn't
+    # break right away
+    #
+    sess.add_breakpoint(out_ip)
+    for iteration in range(2):
+        sess.run([hook])
+        assert sess.stop_reason == bochscpu.StopReason.Breakpoint, sess.stop_reason
+        assert sess.cpu.rip == out_ip, f"{sess.cpu.rip=:#x}"
+        rcx = sess.cpu.state.rcx
+        assert rcx & 0xFFFF == iteration, f"{rcx=:#x}"
+        logging.info(f"Breakpoint hit at {out_ip:#x} with {iteration=}")
+    sess.clear_breakpoints()
+
+    #
+    # 3. Port devices: run to the end, every value read from the counter is echoed to
+    # the latch
+    #
+    sess.run([hook])
+    assert sess.stop_reason == bochscpu.StopReason.Requested, sess.stop_reason
+    assert sess.cpu.state.rcx & 0xFFFF == ITERATIONS, f"{sess.cpu.state.rcx=:#x}"
+    last = int.from_bytes(bochscpu.memory.phy_read(DATA_GPA + 0x10, 2), "little")
+    assert latch.value == last & 0xFF, f"{latch.value=:#x} {last=:#x}"
+    logging.info(f"Counter at {counter.value:#x}, last value read {last:#x}")
+
+    #
+    # 4. Snapshot: restoring brings back the memory written by the guest, and its
+    # registers
+    #
+    sess.restore(snapshot)
+    assert bochscpu.memory.phy_read(DATA_GPA + 0x10, 2) == b"\0\0"
+    assert sess.cpu.rip == 0, f"{sess.cpu.rip=:#x}"
+    assert sess.cpu.state.rcx & 0xFFFF == 0, f"{sess.cpu.state.rcx=:#x}"
+    logging.info("Guest restored")
+
+    #
+    # Cleanup
+    #
+    for gpa, hva in zip((CODE_GPA, DATA_GPA, STACK_GPA), hvas):
+        bochscpu.memory.page_remove(gpa)
+        bochscpu.memory.release_host_page(hva)
+
+
+if __name__ == "__main__":
+    if "--debug" in sys.argv[1:]:
+        logging.basicConfig(format="%(levelname)-7s - %(message)s", level=logging.DEBUG)
+    else:
+        logging.basicConfig(format="%(levelname)-7s - %(message)s", level=logging.INFO)
+
+    ks = keystone.Ks(keystone.KS_ARCH_X86, keystone.KS_MODE_16)
+    code, _ = ks.asm(PROGRAM_ASM)
+    assert isinstance(code, list)
+    code = bytes(code)
+
+    cs = capstone.Cs(capstone.CS_ARCH_X86, capstone.CS_MODE_16)
+    out_ip = next(i.address for i in cs.disasm(code, 0) if i.mnemonic == "out")
+    emulate(code, out_ip)
@@ -6,6 +6,10 @@
 from ._bochscpu import (  # type: ignore
     OpcodeOperationType,
     HookType,
+    HookEvent,
+    StopReason,
+    SyscallPolicy,
+    ExceptionPolicy,
     OpcodeOperationType,
     PrefetchType,
     CacheControlType,
@@ -14,6 +18,12 @@ from ._bochscpu import (  # type: ignore
     Segment,
     GlobalSegment,
     Hook,
+    PortDevice,
+    ConstantPort,
+    LatchPort,
+    CounterPort,
+    SerialPort,
     State,
     Session,
+    Snapshot,
 )
@@ -1,6 +1,8 @@
-from typing import Callable
+from typing import Callable, Optional, Union
 from enum import Enum
+import numpy
 import bochscpu._bochscpu.cpu
+import bochscpu._bochscpu.memory
 
 class GlobalSegment:
     """
@@ -79,6 +81,65 @@ class HookType(Enum):
     TLB_INVVPID: HookType
     TLB_TASKSWITCH: HookType
 
+class HookEvent(Enum):
+    """Class HookEvent"""
+
+    Reset: HookEvent
+    Hlt: HookEvent
+    Mwait: HookEvent
+    CnearBranchTaken: HookEvent
+    CnearBranchNotTaken: HookEvent
+    UcnearBranch: HookEvent
+    FarBranch: HookEvent
+    Opcode: HookEvent
+    Interrupt: HookEvent
+    Exception: HookEvent
+    HwInterrupt: HookEvent
+    TlbCntrl: HookEvent
+    CacheCntrl: HookEvent
+    PrefetchHint: HookEvent
+    Clflush: HookEvent
+    BeforeExecution: HookEvent
+    AfterExecution: HookEvent
+    RepeatIteration: HookEvent
+    Inp: HookEvent
+    Inp2: HookEvent
+    Outp: HookEvent
+    LinAccess: HookEvent
+    PhyAccess: HookEvent
+    Wrmsr: HookEvent
+    Vmexit: HookEvent
+
+class StopReason(Enum):
+    """Class StopReason"""
+
+    Unknown: StopReason
+    Requested: StopReason
+    Breakpoint: StopReason
+    InstructionLimit: StopReason
+    UntilRip: StopReason
+    Watchpoint: StopReason
+    Syscall: StopReason
+    Exception: StopReason
+    Timeout: StopReason
+
+class ExceptionPolicy(Enum):
+    """Class ExceptionPolicy"""
+
+    Ignore: ExceptionPolicy
+    Count: ExceptionPolicy
+    Stop: ExceptionPolicy
+    Reinject: ExceptionPolicy
+    Python: ExceptionPolicy
+
+class SyscallPolicy(Enum):
+    """Class SyscallPolicy"""
+
+    Ignore: SyscallPolicy
+    Count: SyscallPolicy
+    Stop: SyscallPolicy
+    Skip: SyscallPolicy
+
 class InstructionType(Enum):
     IS_CALL: InstructionType
     IS_CALL_INDIRECT: InstructionType
@@ -911,15 +972,55 @@ def instr_imm16(p: int) -> int: ...
 def instr_imm32(p: int) -> int: ...
 def instr_imm64(p: int) -> int: ...
 
+class Snapshot:
+    """
+    CPU state and guest memory captured by `Session.snapshot()`
+    """
+    @property
+    def state(self) -> State:
+        """
+        The captured CPU state
+        """
+        ...
+    @property
+    def pages(self) -> list[int]:
+        """
+        Get the GPAs of the captured pages
+        """
+        ...
+
 class Session:
     """
     Class session
     """
 
     def __init__(self) -> None: ...
-    def run(self, hooks: list[bochscpu.Hook]) -> None:
+    def run(
+        self,
+        hooks: list[bochscpu.Hook] = [],
+        max_instructions: int = 0,
+        until_rip: Optional[int] = None,
+        timeout: Optional[float] = None,
+    ) -> int:
         """
-        Start the execution
+        Start the execution with the registered hooks, followed by `hooks`. If `max_instructions` is non-zero, stop
+        after that many instructions; if `until_rip` is set, stop when that address is reached; if `timeout` is set,
+        stop after that many seconds (`stop_reason` is then `StopReason.Timeout`). Returns the number of executed
+        instructions. The GIL is released during the execution, and only reacquired to invoke Python callbacks.
+        Meanwhile, the session can only be read or changed from those callbacks: other threads get a RuntimeError, as
+        does any change of the hook chain, native hooks or running hooks
+        """
+        ...
+    @property
+    def executed_instructions(self) -> int:
+        """
+        Get the number of instructions executed during the last run
+        """
+        ...
+    @property
+    def stop_reason(self) -> StopReason:
+        """
+        Get the reason why the last run stopped
         """
         ...
     def stop(self) -> None:
@@ -977,6 +1078,505 @@ class Session:
         Alias for `get_auxiliary_variable`
         """
         ...
+    @property
+    def breakpoints(self) -> set[int]:
+        """
+        Get the set of guest RIPs to break on. Breakpoints are checked natively before each instruction, so the
+        execution only leaves the emulator when one is hit
+        """
+        ...
+    @breakpoints.setter
+    def breakpoints(self, rips: set[int]) -> None:
+        """
+        Set the set of guest RIPs to break on
+        """
+        ...
+    def add_breakpoint(self, rip: int) -> None:
+        """
+        Add a breakpoint on the given RIP
+        """
+        ...
+    def remove_breakpoint(self, rip: int) -> bool:
+        """
+        Remove the breakpoint on the given RIP, returns True if it existed
+        """
+        ...
+    def clear_breakpoints(self) -> None:
+        """
+        Remove all the breakpoints
+        """
+        ...
+    @property
+    def breakpoint_handler(self) -> Callable[[bochscpu._bochscpu.Session, int], None]:
+        """
+        Get the callback invoked with (session, rip) when a breakpoint is hit
+        """
+        ...
+    @breakpoint_handler.setter
+    def breakpoint_handler(self, handler: Callable[[bochscpu._bochscpu.Session, int], None]) -> None:
+        """
+        Set the callback invoked with (session, rip) when a breakpoint is hit. If not set, hitting a breakpoint
+        stops the execution
+        """
+        ...
+    def enable_coverage(self, size: int = 0x10000) -> None:
+        """
+        Enable the native edge coverage, collected from the branch events into a map of `size` bytes. Re-enabling
+        resets the map; if the size changes, the views previously obtained from `coverage` keep the old map
+        """
+        ...
+    def disable_coverage(self) -> None:
+        """
+        Disable the native edge coverage, the views previously obtained from `coverage` keep the last map
+        """
+        ...
+    def reset_coverage(self) -> None:
+        """
+        Zero the coverage map
+        """
+        ...
+    @property
+    def coverage(self) -> Optional[numpy.ndarray]:
+        """
+        Get a zero-copy view of the edge coverage map, as a numpy array of hit counters (saturating at 255), or
+        None if the coverage is disabled
+        """
+        ...
+    def enable_memory_trace(self, capacity: int = 0x100000) -> None:
+        """
+        Enable the native memory access trace: every linear and physical access is recorded as (rip, linear,
+        physical, len, rw, access) in a preallocated ring buffer of `capacity` entries (must be a power of 2)
+        """
+        ...
+    def disable_memory_trace(self) -> None:
+        """
+        Disable the native memory access trace, discarding the pending records
+        """
+        ...
+    def drain_memory_trace(self) -> numpy.ndarray:
+        """
+        Dequeue all the pending records of the memory access trace, as a numpy structured array with the fields
+        `rip`, `linear`, `physical`, `len`, `rw` and `access`
+        """
+        ...
+    @property
+    def memory_trace_handler(self) -> Callable[[bochscpu._bochscpu.Session, numpy.ndarray], None]:
+        """
+        Get the callback invoked with (session, records) every time the memory access trace is full
+        """
+        ...
+    @memory_trace_handler.setter
+    def memory_trace_handler(self, handler: Callable[[bochscpu._bochscpu.Session, numpy.ndarray], None]) -> None:
+        """
+        Set the callback invoked with (session, records) every time the memory access trace is full, and when the
+        run returns. Without handler, the accesses recorded while the trace is full are dropped
+        """
+        ...
+    @property
+    def memory_trace_dropped(self) -> int:
+        """
+        Get the number of memory accesses dropped because the trace was full
+        """
+        ...
+    def enable_block_profile(self, capacity: int = 65536) -> None:
+        """
+        Enable the native basic block profiler: the execution and instruction counts of each block, delimited by the
+        branch events, are kept in a hash map of initially `capacity` slots (must be a power of 2)
+        """
+        ...
+    def disable_block_profile(self) -> None:
+        """
+        Disable the basic block profiler, discarding its counters
+        """
+        ...
+    def reset_block_profile(self) -> None:
+        """
+        Discard the counters of the basic block profiler
+        """
+        ...
+    @property
+    def block_profile(self) -> Optional[numpy.ndarray]:
+        """
+        Get the basic block profile as a numpy structured array with the fields `address`, `count` (number of
+        executions) and `instructions` (number of instructions executed in the block), or None if disabled
+        """
+        ...
+    def top_blocks(self, n: int = 10) -> list[tuple[int, int, int]]:
+        """
+        Get the `n` hottest basic blocks, by number of executed instructions, as (address, count, instructions)
+        tuples
+        """
+        ...
+    def enable_shadow_stack(self, max_depth: int = 4096) -> None:
+        """
+        Enable the native shadow call stack, maintained from the near call and return events. Beyond `max_depth`
+        frames, the outermost ones are dropped
+        """
+        ...
+    def disable_shadow_stack(self) -> None:
+        """
+        Disable the native shadow call stack
+        """
+        ...
+    @property
+    def shadow_stack(self) -> list[int]:
+        """
+        Get the return addresses of the shadow call stack, innermost first
+        """
+        ...
+    @property
+    def shadow_stack_frames(self) -> list[tuple[int, int, int, int]]:
+        """
+        Get the frames of the shadow call stack, innermost first, as (call_site, target, return_address,
+        stack_pointer) tuples
+        """
+        ...
+    def enable_function_profile(self) -> None:
+        """
+        Enable the native function profiler: the executed instructions are attributed to the guest functions, along
+        the call paths built from the near call and return events. Calls deeper than 4096 frames are attributed to
+        their caller
+        """
+        ...
+    def disable_function_profile(self) -> None:
+        """
+        Disable the function profiler, discarding its counters
+        """
+        ...
+    def reset_function_profile(self) -> None:
+        """
+        Discard the counters of the function profiler
+        """
+        ...
+    @property
+    def function_profile(self) -> list[tuple[int, int, int, int]]:
+        """
+        Get the function profile as (address, calls, self, inclusive) tuples, sorted by decreasing inclusive
+        instruction count. The entry point of each run counts as a function
+        """
+        ...
+    def function_profile_folded(self, symbols: dict[int, str] = {}) -> str:
+        """
+        Export the self instruction counts of the call paths in the folded stacks format of the flamegraph tools.
+        Functions are named from the `symbols` dict (address to name), or by their address
+        """
+        ...
+    def on_syscall(
+        self, number: int, handler: Callable[[bochscpu._bochscpu.Session, int], Optional[int]]
+    ) -> None:
+        """
+        Register the handler of the SYSCALL/SYSENTER of the given number (RAX), invoked with (session, number) once
+        the instruction executed. If it returns an integer, the syscall is completed natively with that value in RAX
+        (negative values for errors, e.g. -errno), back to user mode; if it returns None, the execution resumes where
+        the instruction led. The other syscalls are handled natively according to `syscall_policy`
+        """
+        ...
+    def remove_syscall_handler(self, number: int) -> bool:
+        """
+        Unregister the handler of the given syscall number, returns True if it existed
+        """
+        ...
+    @property
+    def syscall_policy(self) -> SyscallPolicy:
+        """
+        Get what to do natively with the syscalls without handler
+        """
+        ...
+    @syscall_policy.setter
+    def syscall_policy(self, policy: SyscallPolicy) -> None:
+        """
+        Set what to do natively with the syscalls without handler
+        """
+        ...
+    @property
+    def syscall_skip_value(self) -> int:
+        """
+        Get the value returned by the syscalls skipped with the `Skip` policy (-ENOSYS by default)
+        """
+        ...
+    @syscall_skip_value.setter
+    def syscall_skip_value(self, value: int) -> None:
+        """
+        Set the value returned by the syscalls skipped with the `Skip` policy
+        """
+        ...
+    @property
+    def syscall_counts(self) -> dict[int, int]:
+        """
+        Get the number of syscalls counted by the policies other than `Ignore`, as a dict of number to count
+        """
+        ...
+    def reset_syscall_counts(self) -> None:
+        """
+        Reset the syscall counters
+        """
+        ...
+    def attach_port_device(self, first: int, last: int, device: PortDevice) -> None:
+        """
+        Bind a native device to the I/O ports [first, last]: the `in` and `out` instructions on those ports are
+        handled without calling Python
+        """
+        ...
+    def detach_port_device(self, first: int, last: int) -> bool:
+        """
+        Unbind the device attached to the ports [first, last], returns True if there was one
+        """
+        ...
+    @property
+    def port_devices(self) -> list[tuple[int, int, PortDevice]]:
+        """
+        Get the attached port devices, as (first, last, device) tuples
+        """
+        ...
+    @property
+    def port_read_fallback(self) -> Callable[[bochscpu._bochscpu.Session, int, int], Optional[int]]:
+        """
+        Get the callback invoked when the guest reads a port without device with `in`
+        """
+        ...
+    @port_read_fallback.setter
+    def port_read_fallback(self, cb: Callable[[bochscpu._bochscpu.Session, int, int], Optional[int]]) -> None:
+        """
+        Set the callback invoked with (session, port, len) when the guest reads a port without device with `in`. It
+        returns the value to read, or None to keep the one from the emulator. `ins` is left to the emulator
+        """
+        ...
+    @property
+    def port_write_fallback(self) -> Callable[[bochscpu._bochscpu.Session, int, int, int], None]:
+        """
+        Get the callback invoked when the guest writes a port without device
+        """
+        ...
+    @port_write_fallback.setter
+    def port_write_fallback(self, cb: Callable[[bochscpu._bochscpu.Session, int, int, int], None]) -> None:
+        """
+        Set the callback invoked with (session, port, len, value) when the guest writes a port without device
+        """
+        ...
+    def set_exception_policy(
+        self, vector: Union[int, bochscpu._bochscpu.cpu.ExceptionType], policy: ExceptionPolicy
+    ) -> None:
+        """
+        Set how the exceptions of the given vector are handled natively, without calling Python
+        """
+        ...
+    def get_exception_policy(self, vector: int) -> ExceptionPolicy:
+        """
+        Get how the exceptions of the given vector are handled natively
+        """
+        ...
+    @property
+    def exception_counts(self) -> dict[int, int]:
+        """
+        Get the number of exceptions counted, as a dict of vector to count
+        """
+        ...
+    @property
+    def last_exception(self) -> Optional[tuple[int, int, int, int]]:
+        """
+        Get the last exception counted as a (vector, error_code, rip, cr2) tuple, or None
+        """
+        ...
+    def reset_exception_counts(self) -> None:
+        """
+        Reset the exception counters and the last exception
+        """
+        ...
+    @property
+    def exception_handler(self) -> Callable[[bochscpu._bochscpu.Session, int, int], None]:
+        """
+        Get the callback invoked for the exceptions with the `Python` policy
+        """
+        ...
+    @exception_handler.setter
+    def exception_handler(self, cb: Callable[[bochscpu._bochscpu.Session, int, int], None]) -> None:
+        """
+        Set the callback invoked with (session, vector, error_code) for the exceptions with the `Python` policy
+        """
+        ...
+    def start_trace(self, path: str, window_size: int = 1048576) -> None:
+        """
+        Start recording a compressed control-flow trace (conditional branch outcomes, indirect and far branch
+        targets) of the following runs into `path`, mapped `window_size` bytes at a time. The trace can be decoded
+        with `bochscpu.utils.trace`
+        """
+        ...
+    def stop_trace(self) -> int:
+        """
+        Stop the control-flow trace and close its file. Returns the size of the trace in bytes. Raises a
+        RuntimeError if the trace could not be fully written
+        """
+        ...
+    def add_hook(self, hook: bochscpu._bochscpu.Hook, priority: int = 0) -> int:
+        """
+        Register a hook in the persistent chain used by every `run`, and return its identifier. Hooks of higher
+        priority are invoked first. The chain is only rebuilt when it, or the callbacks of its hooks, change
+        """
+        ...
+    def remove_hook(self, id: int) -> bool:
+        """
+        Unregister the hook of the given identifier, returns True if it existed
+        """
+        ...
+    def clear_hooks(self) -> None:
+        """
+        Unregister all the hooks
+        """
+        ...
+    @property
+    def hooks(self) -> list[tuple[int, int, bochscpu._bochscpu.Hook]]:
+        """
+        Get the registered hooks in chain order, as (id, priority, hook) tuples
+        """
+        ...
+    def load_native_hook(self, path: str, config: str = "") -> int:
+        """
+        Load a native hook plugin (a shared library exporting `bochscpu_plugin_init`, see `bochscpu_plugin.hpp`)
+        with the given configuration string, and add it to the hook chain. Returns its identifier
+        """
+        ...
+    def unload_native_hook(self, id: int) -> bool:
+        """
+        Remove a native hook plugin from the chain and unload it, returns True if it existed
+        """
+        ...
+    def allocate_host_page(self) -> int:
+        """
+        Allocate a page on the host owned by the session, returns its HVA
+        """
+        ...
+    def release_host_page(self, hva: int) -> bool:
+        """
+        Release a host page owned by the session, returns True if it was
+        """
+        ...
+    def release_host_pages(self) -> int:
+        """
+        Release all the host pages owned by the session, which must not be mapped anymore. Returns how many were
+        released
+        """
+        ...
+    @property
+    def host_pages(self) -> list[int]:
+        """
+        Get the HVAs of the host pages owned by the session
+        """
+        ...
+    def snapshot(self) -> Snapshot:
+        """
+        Capture the CPU state and the content of the guest pages mapped through the memory module, and start
+        tracking the pages written from then on
+        """
+        ...
+    def restore(self, snapshot: Snapshot) -> int:
+        """
+        Restore the CPU state and the guest memory of a snapshot. Only the pages written since the snapshot was
+        taken or last restored are copied back, unless another snapshot was taken or restored in the meantime.
+        Writes made through `memory.phy_view()` are not tracked. Returns the number of restored pages
+        """
+        ...
+    @property
+    def native_hooks(self) -> list[tuple[int, str, str]]:
+        """
+        Get the loaded native hook plugins, as (id, path, config) tuples
+        """
+        ...
+    def add_watchpoint(self, gva_start: int, size: int, access_type: bochscpu._bochscpu.memory.AccessType) -> None:
+        """
+        Watch the guest linear range [gva_start, gva_start + size) for the given type of access. The accesses are
+        checked natively, Python is only involved when a watchpoint is hit
+        """
+        ...
+    def remove_watchpoint(self, gva_start: int, size: int) -> bool:
+        """
+        Remove the watchpoints on the given range, returns True if any existed
+        """
+        ...
+    def clear_watchpoints(self) -> None:
+        """
+        Remove all the watchpoints
+        """
+        ...
+    @property
+    def watchpoints(self) -> list[tuple[int, int, bochscpu._bochscpu.memory.AccessType]]:
+        """
+        Get the list of watchpoints, as (gva_start, size, access_type) tuples
+        """
+        ...
+    @property
+    def watchpoint_handler(
+        self,
+    ) -> Callable[[bochscpu._bochscpu.Session, int, int, bochscpu._bochscpu.memory.AccessType], None]:
+        """
+        Get the callback invoked with (session, address, len, access_type) when a watchpoint is hit
+        """
+        ...
+    @watchpoint_handler.setter
+    def watchpoint_handler(
+        self, handler: Callable[[bochscpu._bochscpu.Session, int, int, bochscpu._bochscpu.memory.AccessType], None]
+    ) -> None:
+        """
+        Set the callback invoked with (session, address, len, access_type) when a watchpoint is hit. If not set,
+        hitting a watchpoint stops the execution after the accessing instruction
+        """
+        ...
+
+class PortDevice:
+    """
+    Base class of the native I/O port devices
+    """
+
+    ...
+
+class ConstantPort(PortDevice):
+    """
+    Port device always reading the same value, and ignoring the writes
+    """
+
+    def __init__(self, value: int) -> None: ...
+    value: int
+
+class LatchPort(PortDevice):
+    """
+    Port device reading the last value written
+    """
+
+    def __init__(self, value: int = 0) -> None: ...
+    value: int
+
+class CounterPort(PortDevice):
+    """
+    Port device reading a counter incremented by `step` after every read, the writes set the counter
+    """
+
+    def __init__(self, value: int = 0, step: int = 1) -> None: ...
+    value: int
+    step: int
+
+class SerialPort(PortDevice):
+    """
+    Minimal 16550 UART capturing the transmitted bytes, to attach to its 8 ports from `base`
+    """
+
+    def __init__(self, base: int = 0x3F8) -> None: ...
+    @property
+    def base(self) -> int: ...
+    @property
+    def output(self) -> bytes:
+        """
+        Get the bytes transmitted by the guest
+        """
+        ...
+    def clear_output(self) -> None:
+        """
+        Discard the bytes transmitted by the guest
+        """
+        ...
+    def feed(self, data: bytes) -> None:
+        """
+        Queue bytes for the guest to receive
+        """
+        ...
 
 class Hook:
     """
@@ -1071,13 +1671,13 @@ class Hook:
     @property
     def ctx(self) -> int:
         """
-        A raw pointer to the Session object
+        A user-defined pointer, left untouched by the sessions: the callbacks get their session as first argument
         """
         ...
     @ctx.setter
     def ctx(self) -> int:
         """
-        A raw pointer to the Session object
+        A user-defined pointer, left untouched by the sessions: the callbacks get their session as first argument
         """
         ...
     @property
@@ -1340,3 +1940,70 @@ class Hook:
         Callback for Bochs `wrmsr` callback
         """
         ...
+    @property
+    def event_mask(self) -> int:
+        """
+        Get the mask of the events the hook subscribes to: bit `n` is set if the callback for `HookEvent(n)` is
+        defined. Only those events will be dispatched by the emulator
+        """
+        ...
+    def has_event(self, event: HookEvent) -> bool:
+        """
+        Indicates whether the hook subscribes to the given event
+        """
+        ...
+    @property
+    def batch_size(self) -> int:
+        """
+        Get the batch size
+        """
+        ...
+    @batch_size.setter
+    def batch_size(self, size: int) -> None:
+        """
+        Set the batch size. If non-zero and `batch` is set, the `batch_events` are recorded natively and delivered
+        `batch_size` at a time to `batch` instead of their own callbacks
+        """
+        ...
+    @property
+    def batch_events(self) -> int:
+        """
+        Get the mask of the events to batch
+        """
+        ...
+    @batch_events.setter
+    def batch_events(self, mask: int) -> None:
+        """
+        Set the mask of the events to batch (by default BeforeExecution, AfterExecution and RepeatIteration)
+        """
+        ...
+    @property
+    def batch(self) -> Callable[[bochscpu._bochscpu.Session, numpy.ndarray], None]:
+        """
+        Callback for the batched events
+        """
+        ...
+    @batch.setter
+    def batch(self, cb: Callable[[bochscpu._bochscpu.Session, numpy.ndarray], None]) -> None:
+        """
+        Callback for the batched events, invoked with (session, records) where records is a numpy structured array
+        with the fields `rip`, `event` (a `HookEvent` value) and `cpu_id`
+        """
+        ...
+    def add_range(self, start: int, end: int) -> None:
+        """
+        Restrict the execution, branch and linear access callbacks to the guest addresses in [start, end).
+        Overlapping ranges are merged
+        """
+        ...
+    def clear_ranges(self) -> None:
+        """
+        Remove all the address ranges, the callbacks are then invoked for any address
+        """
+        ...
+    @property
+    def ranges(self) -> list[tuple[int, int]]:
+        """
+        Get the sorted list of (start, end) address ranges the hook is restricted to
+        """
+        ...
@@ -1,4 +1,4 @@
-from typing import Optional
+from typing import Optional, Union
 from enum import Enum
 
 class AccessType(Enum):
@@ -42,13 +42,33 @@ def page_size() -> int:
 
 def allocate_host_page() -> int:
     """
-    Allocate (VirtualAlloc/mmap) a page on the host, returns the HVA on success, 0 otherwise
+    Allocate a zeroed page on the host, carved from a 2MB arena (VirtualAlloc/mmap), returns the HVA on success
     """
     ...
 
-def release_host_page(hva: int) -> None:
+def release_host_page(hva: int) -> bool:
     """
-    Release (VirtualFree/munmap) a page on the host
+    Release a page on the host, it is reused by the following allocations. Returns False for the pages not
+    allocated by `allocate_host_page`, including the ones owned by a session
+    """
+    ...
+
+def release_host_pages(hvas: list[int]) -> int:
+    """
+    Release pages on the host, returns how many were allocated and got released. The pages owned by a session are
+    skipped
+    """
+    ...
+
+def dirty_pages() -> list[int]:
+    """
+    Get the GPAs of the pages written since the last `Session.snapshot()` or `Session.restore()`
+    """
+    ...
+
+def host_page_arenas() -> list[tuple[int, int, int, int]]:
+    """
+    Statistics of the host page arenas, as (base, capacity, used, touched) tuples, the last three in pages
     """
     ...
 
@@ -64,38 +84,84 @@ def page_remove(gpa: int) -> None:
     """
     ...
 
-def phy_read(gpa: int, size: int) -> list[int]:
+def map_range(gpa: int, size: int) -> int:
+    """
+    Allocate a contiguous zeroed host region of `size` bytes (rounded up to the page size), and map it at GPA.
+    Returns its HVA, to release with `release_host_range` once unmapped
+    """
+    ...
+
+def page_insert_range(gpa: int, hva: int, size: int) -> None:
+    """
+    Map the page-aligned GPA range to the host range starting at HVA
+    """
+    ...
+
+def page_remove_range(gpa: int, size: int) -> None:
+    """
+    Remove the pages of the page-aligned GPA range
+    """
+    ...
+
+def release_host_range(hva: int) -> bool:
+    """
+    Release a host region allocated by `map_range`
+    """
+    ...
+
+def phy_read(gpa: int, size: int) -> bytes:
     """
     Read from GPA
     """
     ...
 
+def phy_view(gpa: int, size: int) -> memoryview:
+    """
+    Get a writable memoryview of the host memory behind [GPA, GPA + size), without copy. The range must be backed
+    by contiguous host memory, and the view is only valid while it stays mapped
+    """
+    ...
+
 def phy_translate(gpa: int) -> int:
     """
     Translate from GPA to HVA
     """
     ...
 
-def phy_write(gpa: int, bytes: bytes) -> None:
+def phy_read_into(gpa: int, out: Union[bytearray, memoryview]) -> int:
+    """
+    Read from GPA into a writable contiguous buffer (bytearray, memoryview, numpy array, ...), as much as it holds.
+    Returns the number of bytes read
+    """
+    ...
+
+def phy_write(gpa: int, hva: Union[bytes, bytearray, memoryview, list[int]]) -> None:
     """
-    Write to GPA
+    Write a contiguous buffer (bytes, bytearray, memoryview, numpy array, ...) or a list of ints to GPA
     """
     ...
 
-def virt_read(cr3: int, gva: int, sz: int) -> list[int]:
+def virt_read(cr3: int, gva: int, sz: int) -> bytes:
     """
     Read from GVA
     """
     ...
 
+def virt_read_into(cr3: int, gva: int, out: Union[bytearray, memoryview]) -> int:
+    """
+    Read from GVA into a writable contiguous buffer (bytearray, memoryview, numpy array, ...), as much as it holds.
+    Returns the number of bytes read
+    """
+    ...
+
 def virt_translate(cr3: int, gva: int) -> int:
     """
     Translate from GVA to HVA
     """
     ...
 
-def virt_write(cr3: int, gva: int, bytes: bytes) -> bool:
+def virt_write(cr3: int, gva: int, bytes: Union[bytes, bytearray, memoryview, list[int]]) -> bool:
     """
-    Write to GVA
+    Write a contiguous buffer (bytes, bytearray, memoryview, numpy array, ...) or a list of ints to GVA
     """
     ...
@@ -5,7 +5,7 @@ import bochscpu.cpu
 import bochscpu.memory
 import bochscpu._bochscpu as _bochscpu
 
-from . import cpu, callbacks
+from . import cpu, callbacks, trace
 
 PAGE_SIZE = bochscpu.memory.page_size()
 
@@ -93,7 +93,7 @@ def dump_page_table(pml4: int):
     def __dump_page_table(addr: int, level: int = 0):
         level_str = ("PML", "PDPT", "PD", "PT")
         if level == 4:
-            data = bytes(bochscpu.memory.phy_read(addr, 8))
+            data = bochscpu.memory.phy_read(addr, 8)
             entry = struct.unpack("<Q", data[:8])[0] & ~0xFFF
             print(f"{' '*level} {entry:#x}")
             return
@@ -101,7 +101,7 @@ def dump_page_table(pml4: int):
         print(f"Dumping {level_str[level]}Es @ {addr:#x}")
 
         for i in range(0, PAGE_SIZE, 8):
-            data = bytes(bochscpu.memory.phy_read(addr + i, 8))
+            data = bochscpu.memory.phy_read(addr + i, 8)
             entry = struct.unpack("<Q", data[:8])[0]
             flags = entry & 0xFFF
             entry = entry & ~0xFFF
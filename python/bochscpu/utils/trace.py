@@ -0,0 +1,102 @@
+"""Decoder for the compressed control-flow traces recorded with `Session.start_trace()`
+
+The trace only holds what cannot be recovered from the guest code (like Intel PT): the outcomes of the
+conditional branches, and the targets of the indirect and far branches. Rebuilding the executed path requires
+walking the code from the `Start` address, consuming one outcome per conditional branch and one target per
+indirect branch.
+"""
+
+import enum
+import mmap
+import pathlib
+import struct
+from typing import Iterator, NamedTuple, Union
+
+MAGIC = b"BXCFTRC\0"
+VERSION = 1
+HEADER_SIZE = 16
+
+
+class PacketType(enum.IntEnum):
+    Start = 0x03
+    End = 0x07
+    Branch = 0x00
+    Indirect = 0x01
+    Far = 0x05
+
+
+class Packet(NamedTuple):
+    """A decoded trace packet. `value` is:
+    - the RIP for `Start`
+    - True if the branch was taken for `Branch`
+    - the target RIP for `Indirect`
+    - the target RIP for `Far`, `cs` holding the target code segment
+    - the number of executed instructions for `End`
+    """
+
+    type: PacketType
+    value: Union[int, bool]
+    cs: int = 0
+
+
+def _read_varint(buf, pos: int) -> tuple[int, int]:
+    value, shift = 0, 0
+    while True:
+        byte = buf[pos]
+        pos += 1
+        value |= (byte & 0x7F) << shift
+        shift += 7
+        if not byte & 0x80:
+            return value, pos
+
+
+def decode(path: Union[str, pathlib.Path]) -> Iterator[Packet]:
+    """Decode a control-flow trace file
+
+    Args:
+        path (Union[str, pathlib.Path]): path of the trace
+
+    Yields:
+        Iterator[Packet]: the packets of the trace, in execution order
+    """
+    with open(path, "rb") as f:
+        with mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ) as buf:
+            magic, version, _ = struct.unpack_from("<8sII", buf, 0)
+            if magic != MAGIC:
+                raise ValueError(f"{path} is not a control-flow trace")
+            if version != VERSION:
+                raise ValueError(f"Unsupported trace version {version}")
+
+            pos, last_ip, size = HEADER_SIZE, 0, len(buf)
+            while pos < size:
+                byte = buf[pos]
+                pos += 1
+
+                if byte == 0x00:
+                    continue
+
+                if not byte & 1:
+                    #
+                    # TNT: the outcomes go from below the stop bit (oldest) down to bit 1
+                    #
+                    for i in range(byte.bit_length() - 2, 0, -1):
+                        yield Packet(PacketType.Branch, bool((byte >> i) & 1))
+                    continue
+
+                if byte == PacketType.Start:
+                    last_ip, pos = _read_varint(buf, pos)
+                    yield Packet(PacketType.Start, last_ip)
+                elif byte == PacketType.Indirect:
+                    value, pos = _read_varint(buf, pos)
+                    last_ip ^= value
+                    yield Packet(PacketType.Indirect, last_ip)
+                elif byte == PacketType.Far:
+                    (cs,) = struct.unpack_from("<H", buf, pos)
+                    value, pos = _read_varint(buf, pos + 2)
+                    last_ip ^= value
+                    yield Packet(PacketType.Far, last_ip, cs)
+                elif byte == PacketType.End:
+                    value, pos = _read_varint(buf, pos)
+                    yield Packet(PacketType.End, value)
+                else:
+                    raise ValueError(f"Invalid packet {byte:#x} at offset {pos - 1:#x}")
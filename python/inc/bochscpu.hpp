@@ -1,8 +1,20 @@
+#include <algorithm>
 #include <array>
+#include <atomic>
 #include <bitset>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
 #include <functional>
 #include <memory>
+#include <mutex>
 #include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
@@ -16,27 +28,17 @@
 #error Not supported
 #endif // _WIN32
 
+#include <nanobind/nanobind.h>
+
 #include "bochscpu/bochscpu.hpp"
+#include "bochscpu_allocator.hpp"
+#include "bochscpu_devices.hpp"
+#include "bochscpu_log.hpp"
+#include "bochscpu_plugin.hpp"
+#include "bochscpu_profile.hpp"
+#include "bochscpu_snapshot.hpp"
+#include "bochscpu_trace.hpp"
 
-// #define DEBUG
-
-#ifdef DEBUG
-#define dbg(fmt, ...) ::printf("[*] %s:%d - " fmt "\n", __FUNCTION__, __LINE__, __VA_ARGS__)
-#define info(fmt, ...) ::printf("[+] %s:%d - " fmt "\n", __FUNCTION__, __LINE__, __VA_ARGS__)
-#define warn(fmt, ...) ::printf("[!] %s:%d - " fmt "\n", __FUNCTION__, __LINE__, __VA_ARGS__)
-#define err(fmt, ...) ::printf("[-] %s:%d - " fmt "\n", __FUNCTION__, __LINE__, __VA_ARGS__)
-#else
-#define dbg(fmt, ...)
-#if defined(_WIN32)
-#define info(fmt, ...) ::printf("[+] " fmt "\n", __VA_ARGS__)
-#define warn(fmt, ...) ::printf("[!] " fmt "\n", __VA_ARGS__)
-#define err(fmt, ...) ::printf("[-] " fmt "\n", __VA_ARGS__)
-#elif defined(__LINUX__) || defined(__linux__) || defined(__APPLE__) || defined(__MACH__)
-#define info(fmt, ...) ::printf("[+] " fmt "\n" __VA_OPT__(, ) __VA_ARGS__)
-#define warn(fmt, ...) ::printf("[!] " fmt "\n" __VA_OPT__(, ) __VA_ARGS__)
-#define err(fmt, ...) ::printf("[-] " fmt "\n" __VA_OPT__(, ) __VA_ARGS__)
-#endif
-#endif // DEBUG
 
 //
 // Some missing defines
@@ -66,6 +68,8 @@
 
 namespace BochsCPU
 {
+namespace nb = nanobind;
+
 ///
 /// @brief Src https://github.com/bochs-emu/Bochs/blob/86eff7597d72af912d708a10c0a2000d0b9973c2/bochs/cpu/cpu.h#L312
 ///
@@ -174,6 +178,88 @@ enum class PrefetchType
     INSTR_PREFETCH_T2  = BX_INSTR_PREFETCH_T2,
 };
 
+///
+/// @brief What to do natively with the syscalls without a registered handler
+///
+enum class SyscallPolicy : uint32_t
+{
+    Ignore, // Not intercepted, nor counted
+    Count,  // Counted, then handled by the guest kernel
+    Stop,   // Counted, then the execution stops
+    Skip,   // Counted, then returned from with `Session::syscall_skip_value`
+};
+
+
+///
+/// @brief What to do natively when a CPU exception is raised, per vector
+///
+enum class ExceptionPolicy : uint32_t
+{
+    Ignore,   // Nothing is done natively (the hooks are still invoked)
+    Count,    // Counted
+    Stop,     // Counted, then the execution stops
+    Reinject, // Counted, then raised again with `bochscpu_cpu_set_exception` before the next instruction
+    Python,   // Counted, then `Session::exception_handler` is called
+};
+
+
+///
+/// @brief Why the last `Session::run` stopped
+///
+enum class StopReason : uint32_t
+{
+    Unknown,          // Not stopped by the session, e.g. the execution ended on its own
+    Requested,        // `Session.stop()` was called
+    Breakpoint,       // A breakpoint was hit without handler
+    InstructionLimit, // The instruction budget of the run was exhausted
+    UntilRip,         // The `until_rip` address of the run was reached
+    Watchpoint,       // A watchpoint was hit without handler
+    Syscall,          // A syscall was intercepted with the `Stop` policy
+    Exception,        // An exception was raised with the `Stop` policy
+    Timeout,          // The `timeout` of the run expired
+};
+
+///
+/// @brief X-macro listing every instrumentation event exposed by `bochscpu_hooks_t`, as pairs of
+/// (`Hook` field name, `HookEvent` name).
+///
+#define BOCHSCPU_FOREACH_HOOK_EVENT(X)                                                                                 \
+    X(reset, Reset)                                                                                                    \
+    X(hlt, Hlt)                                                                                                        \
+    X(mwait, Mwait)                                                                                                    \
+    X(cnear_branch_taken, CnearBranchTaken)                                                                            \
+    X(cnear_branch_not_taken, CnearBranchNotTaken)                                                                     \
+    X(ucnear_branch, UcnearBranch)                                                                                     \
+    X(far_branch, FarBranch)                                                                                           \
+    X(opcode, Opcode)                                                                                                  \
+    X(interrupt, Interrupt)                                                                                            \
+    X(exception, Exception)                                                                                            \
+    X(hw_interrupt, HwInterrupt)                                                                                       \
+    X(tlb_cntrl, TlbCntrl)                                                                                             \
+    X(cache_cntrl, CacheCntrl)                                                                                         \
+    X(prefetch_hint, PrefetchHint)                                                                                     \
+    X(clflush, Clflush)                                                                                                \
+    X(before_execution, BeforeExecution)                                                                               \
+    X(after_execution, AfterExecution)                                                                                 \
+    X(repeat_iteration, RepeatIteration)                                                                               \
+    X(inp, Inp)                                                                                                        \
+    X(inp2, Inp2)                                                                                                      \
+    X(outp, Outp)                                                                                                      \
+    X(lin_access, LinAccess)                                                                                           \
+    X(phy_access, PhyAccess)                                                                                           \
+    X(wrmsr, Wrmsr)                                                                                                    \
+    X(vmexit, Vmexit)
+
+///
+/// @brief Instrumentation events, used as bit indexes in `Hook::EventMask()`
+///
+enum class HookEvent : uint32_t
+{
+#define X(field, name) name,
+    BOCHSCPU_FOREACH_HOOK_EVENT(X)
+#undef X
+};
+
 namespace Callbacks
 {
 namespace Memory
@@ -257,6 +343,70 @@ opcode_cb(context_t* ctx, uint32_t cpu_id, void*, uint8_t*, uintptr_t, bool, boo
 void
 exception_cb(context_t* ctx, uint32_t cpu_id, unsigned vector, unsigned error_code);
 
+///
+/// @brief Trampolines for the features implemented natively by the `Session` itself. For those, the
+/// context is the `Session` pointer and no Python code is involved unless a handler must be notified.
+///
+namespace Native
+{
+///
+/// @brief X-macro listing the events for which a native trampoline exists, with the same layout as
+/// `BOCHSCPU_FOREACH_HOOK_EVENT`
+///
+#define BOCHSCPU_FOREACH_NATIVE_HOOK_EVENT(X)                                                                          \
+    X(before_execution, BeforeExecution)                                                                               \
+    X(cnear_branch_taken, CnearBranchTaken)                                                                            \
+    X(cnear_branch_not_taken, CnearBranchNotTaken)                                                                     \
+    X(ucnear_branch, UcnearBranch)                                                                                     \
+    X(far_branch, FarBranch)                                                                                           \
+    X(lin_access, LinAccess)                                                                                           \
+    X(phy_access, PhyAccess)                                                                                           \
+    X(after_execution, AfterExecution)                                                                                 \
+    X(inp2, Inp2)                                                                                                      \
+    X(outp, Outp)                                                                                                      \
+    X(exception, Exception)
+
+void
+before_execution_cb(context_t* ctx, uint32_t cpu_id, void* insn);
+
+void
+exception_cb(context_t* ctx, uint32_t cpu_id, unsigned vector, unsigned error_code);
+
+void
+after_execution_cb(context_t* ctx, uint32_t cpu_id, void* insn);
+
+void
+inp2_cb(context_t* ctx, uint16_t port, uintptr_t len, unsigned val);
+
+void
+outp_cb(context_t* ctx, uint16_t port, uintptr_t len, unsigned val);
+
+void
+cnear_branch_taken_cb(context_t* ctx, uint32_t cpu_id, uint64_t branch_eip, uint64_t new_branch_eip);
+
+void
+cnear_branch_not_taken_cb(context_t* ctx, uint32_t cpu_id, uint64_t branch_eip, uint64_t new_branch_eip);
+
+void
+ucnear_branch_cb(context_t* ctx, uint32_t cpu_id, unsigned what, uint64_t branch_eip, uint64_t new_eip);
+
+void
+far_branch_cb(
+    context_t* ctx,
+    uint32_t cpu_id,
+    uint32_t what,
+    uint16_t prev_cs,
+    uint64_t prev_eip,
+    uint16_t new_cs,
+    uint64_t new_eip);
+
+void
+lin_access_cb(context_t* ctx, uint32_t cpu_id, uint64_t lin, uint64_t phy, uintptr_t len, uint32_t rw, uint32_t access);
+
+void
+phy_access_cb(context_t* ctx, uint32_t cpu_id, uint64_t phy, uintptr_t len, uint32_t rw, uint32_t access);
+} // namespace Native
+
 } // namespace Callbacks
 
 
@@ -431,18 +581,87 @@ enum class Access : uint32_t
     Execute = (uint32_t)BochsCPU::HookType::BOCHSCPU_HOOK_MEM_EXECUTE,
 };
 
-uintptr_t
-PageSize();
-
-uint64_t
-AlignAddressToPage(uint64_t va);
-
 uint64_t
 AllocatePage();
 
 bool
 FreePage(uint64_t addr);
 
+///
+/// @brief Release pages, taking the allocator lock once. Pages not owned by the allocator, or owned by a
+/// session, are skipped.
+///
+/// @return the number of released pages
+///
+size_t
+FreePages(std::vector<uint64_t> const& addrs);
+
+///
+/// @brief Map the guest physical range [gpa, gpa + size) to the host range starting at `hva`
+///
+void
+PageInsertRange(uint64_t gpa, uint64_t hva, uint64_t size);
+
+void
+PageRemoveRange(uint64_t gpa, uint64_t size);
+
+///
+/// @brief Create a bytes object of `size` bytes, uninitialized: `buffer` receives its content for the caller
+/// to fill, which avoids an intermediate copy
+///
+nb::bytes
+AllocateBytes(uint64_t size, uint8_t*& buffer);
+
+///
+/// @brief Contiguous view of a Python object supporting the buffer protocol, held for the lifetime of the
+/// instance
+///
+class BufferView
+{
+public:
+    BufferView(nb::handle obj, bool writable);
+
+    ~BufferView();
+
+    BufferView(BufferView const&) = delete;
+
+    BufferView&
+    operator=(BufferView const&) = delete;
+
+    uint8_t*
+    data() const
+    {
+        return (uint8_t*)m_View.buf;
+    }
+
+    size_t
+    size() const
+    {
+        return (size_t)m_View.len;
+    }
+
+private:
+    Py_buffer m_View {};
+};
+
+///
+/// @brief Translate the guest physical range [gpa, gpa + size), which must be backed by contiguous host memory
+///
+/// @return the HVA of `gpa`
+///
+uint8_t*
+PhyTranslateRange(uint64_t gpa, uint64_t size);
+
+
+///
+/// @brief Map the page of `gpa` to `hva`, and record it in `MappedPages`
+///
+void
+PageInsert(uint64_t gpa, uint8_t* hva);
+
+void
+PageRemove(uint64_t gpa);
+
 
 //
 // @ref AMD Programmer's Manual Volume 2, Figure 5.17
@@ -596,6 +815,7 @@ missing_page_cb(uint64_t gpa)
     if ( BochsCPU::Memory::missing_page_handler )
     {
         dbg("Missing GPA=%#llx", gpa);
+        nb::gil_scoped_acquire gil;
         (*missing_page_handler)(gpa);
     }
     else
@@ -606,6 +826,144 @@ missing_page_cb(uint64_t gpa)
 } // namespace Memory
 
 
+namespace Utils
+{
+struct FieldDescriptor
+{
+    const char* name;
+    const char* format;
+    size_t offset;
+};
+
+///
+/// @brief Copy an array of `count` records of `itemsize` bytes into a numpy structured array whose
+/// fields are described by `fields`
+///
+nb::object
+ToStructuredArray(void const* data, size_t count, size_t itemsize, std::initializer_list<FieldDescriptor> fields);
+} // namespace Utils
+
+
+///
+/// @brief A memory access recorded by the native memory trace. For physical accesses, `linear` is 0.
+///
+struct MemoryAccessRecord
+{
+    uint64_t rip {};
+    uint64_t linear {};
+    uint64_t physical {};
+    uint32_t len {};
+    uint32_t rw {};
+    uint32_t access {};
+};
+
+
+///
+/// @brief A guest linear memory range [start, end) watched for a type of access
+///
+struct Watchpoint
+{
+    uint64_t start {};
+    uint64_t end {};
+    BochsCPU::Memory::Access access {};
+};
+
+
+struct Hook;
+struct HookContext;
+struct Session;
+
+
+///
+/// @brief Wall-clock watchdog: a thread, started on first use, that stops the session once the deadline
+/// passes
+///
+class Watchdog
+{
+public:
+    Watchdog(Session* session) : m_Session {session}
+    {
+    }
+
+    ~Watchdog();
+
+    void
+    Arm(std::chrono::steady_clock::duration timeout);
+
+    ///
+    /// @brief Cancel the deadline. Once this returns, the watchdog can't stop the session anymore
+    ///
+    void
+    Disarm();
+
+    ///
+    /// @brief Arms the watchdog for its lifetime
+    ///
+    struct ArmedScope
+    {
+        ArmedScope(Watchdog& watchdog, std::chrono::steady_clock::duration timeout) : m_Watchdog {watchdog}
+        {
+            m_Watchdog.Arm(timeout);
+        }
+
+        ~ArmedScope()
+        {
+            m_Watchdog.Disarm();
+        }
+
+        Watchdog& m_Watchdog;
+    };
+
+private:
+    void
+    Thread();
+
+    Session* m_Session;
+    std::thread m_Thread;
+    std::mutex m_Lock;
+    std::condition_variable m_Cond;
+    std::optional<std::chrono::steady_clock::time_point> m_Deadline {};
+
+    ///
+    /// @brief Set from `Arm` to `Disarm`, i.e. while the CPU runs: the watchdog only stops it meanwhile
+    ///
+    bool m_InRun {false};
+    bool m_Quit {false};
+};
+
+
+///
+/// @brief A hook registered in the persistent chain of a session
+///
+struct RegisteredHook
+{
+    uint64_t id {};
+    int32_t priority {};
+    nb::object owner {};
+    Hook* hook {};
+    uint32_t mask {};
+
+    ///
+    /// @brief Context given to the trampolines of this registration
+    ///
+    std::shared_ptr<HookContext> context;
+};
+
+
+///
+/// @brief A native hook plugin loaded in a session, see `bochscpu_plugin.hpp`
+///
+struct NativeHook
+{
+    uint64_t id {};
+    std::string path {};
+    std::string config {};
+    void* module {};
+    bochscpu_hooks_t hooks {};
+    bochscpu_plugin_fini_t fini {};
+};
+
+
 struct Session
 {
     Session() : cpu {}, auxiliaries {}
@@ -617,13 +975,533 @@ struct Session
 
     ~Session()
     {
+        ClearNativeHooks();
         BochsCPU::Memory::missing_page_handler.release();
     }
 
+    ///
+    /// @brief Get the events the session needs to handle natively for its own features (breakpoints,
+    /// etc.). Bit `n` is set if `HookEvent(n)` must be dispatched to the session.
+    ///
+    uint32_t
+    EventMask() const;
+
+    ///
+    /// @brief Populate a `bochscpu_hooks_t` with the native trampolines required by the session features.
+    ///
+    /// @return the event mask of the installed trampolines
+    ///
+    uint32_t
+    Install(bochscpu_hooks_t& hooks);
+
+    ///
+    /// @brief Run the emulation with the registered hook chain, followed by the `extra` hooks
+    ///
+    /// @return the number of executed instructions
+    ///
+    uint64_t
+    Run(std::vector<Hook*> const& extra,
+        uint64_t max_instructions,
+        std::optional<uint64_t> until_rip,
+        std::optional<double> timeout = std::nullopt);
+
+    ///
+    /// @brief Register a hook in the persistent chain. Hooks of higher priority are invoked first, hooks of
+    /// the same priority in registration order.
+    ///
+    /// @return the identifier of the registration
+    ///
+    uint64_t
+    AddHook(nb::object hook, int32_t priority);
+
+    bool
+    RemoveHook(uint64_t id);
+
+    void
+    ClearHooks();
+
+    ///
+    /// @brief Get the compiled hook chain, only rebuilding it if a hook or the session features changed
+    /// since the last call
+    ///
+    std::vector<bochscpu_hooks_t*> const&
+    CompileChain();
+
+    ///
+    /// @brief The persistent hook chain, sorted by decreasing priority
+    ///
+    std::vector<RegisteredHook> registered_hooks;
+
+    uint64_t next_hook_id {1};
+
+    ///
+    /// @brief Load a native hook plugin and add it to the chain, after the session native features and
+    /// before the Python hooks
+    ///
+    /// @return the identifier of the plugin
+    ///
+    uint64_t
+    LoadNativeHook(std::string const& path, std::string const& config);
+
+    bool
+    UnloadNativeHook(uint64_t id);
+
+    void
+    ClearNativeHooks();
+
+    std::vector<NativeHook> native_hooks;
+
+    ///
+    /// @brief Allocate a host page owned by the session, see `ReleaseHostPages`
+    ///
+    uint64_t
+    AllocateHostPage();
+
+    bool
+    ReleaseHostPage(uint64_t hva);
+
+    ///
+    /// @brief Release every host page owned by the session. They must not be mapped in the guest anymore.
+    ///
+    /// @return the number of released pages
+    ///
+    size_t
+    ReleaseHostPages();
+
+    std::unordered_set<uint64_t> host_pages;
+
+    ///
+    /// @brief Capture the CPU state and the mapped guest pages, and start tracking the pages written from then on
+    ///
+    std::shared_ptr<Snapshot>
+    TakeSnapshot();
+
+    ///
+    /// @brief Restore the CPU state and the guest pages of a snapshot. Only the pages written since `snapshot` was
+    /// taken or last restored are copied back, unless another snapshot was taken or restored in the meantime.
+    ///
+    /// @return the number of restored pages
+    ///
+    size_t
+    RestoreSnapshot(Snapshot const& snapshot);
+
+    ///
+    /// @brief Native control-flow tracer, fed from the branch events. Null if disabled.
+    ///
+    std::unique_ptr<ControlFlowTracer> tracer;
+
+    ///
+    /// @brief Native basic block profile, fed from the branch events: a block starts at the RIP a run starts
+    /// from, or at a branch destination. Disabled when its capacity is 0.
+    ///
+    BlockCounter block_profile;
+
+    ///
+    /// @brief Native shadow call stack, fed from the `ucnear_branch` events
+    ///
+    ShadowStack shadow_stack;
+
+    ///
+    /// @brief Native function profiler, fed from the `ucnear_branch` events
+    ///
+    FunctionProfiler function_profiler;
+
+    ///
+    /// @brief Python handlers of the syscalls, per number (RAX). A handler returns the value to return to the
+    /// guest with (negative values being errors, stored in RAX as two's complement), or None to leave the
+    /// execution where the syscall instruction led
+    ///
+    std::unordered_map<uint64_t, std::function<std::optional<int64_t>(Session*, uint64_t)>> syscall_handlers;
+
+    SyscallPolicy syscall_policy {SyscallPolicy::Ignore};
+
+    ///
+    /// @brief Value returned by the syscalls skipped by the `Skip` policy, -ENOSYS by default
+    ///
+    int64_t syscall_skip_value {-38};
+
+    ///
+    /// @brief Number of syscalls, per number, counted unless the policy is `Ignore`
+    ///
+    std::unordered_map<uint64_t, uint64_t> syscall_counts;
+
+    ///
+    /// @brief Dispatch a SYSCALL or SYSENTER, reported once executed as a far branch from `user_cs`
+    ///
+    void
+    DispatchSyscall(uint32_t what, uint16_t user_cs);
+
+    ///
+    /// @brief Complete the current syscall natively: set RAX to `value` and go back to user mode like
+    /// SYSRET or SYSEXIT would
+    ///
+    void
+    ReturnFromSyscall(uint32_t what, uint16_t user_cs, uint64_t value);
+
+    ///
+    /// @brief Native I/O port devices: the devices keep the registrations alive, the table maps every port to
+    /// its device. The table is empty until a device is attached.
+    ///
+    std::vector<std::tuple<uint16_t, uint16_t, std::shared_ptr<Devices::PortDevice>>> port_devices;
+    std::vector<Devices::PortDevice*> port_table;
+
+    ///
+    /// @brief Python fallbacks for the ports without a device. The read fallback returns the value the
+    /// guest reads, or None to keep the one from the emulator.
+    ///
+    std::function<std::optional<uint32_t>(Session*, uint16_t, uint32_t)> port_read_fallback;
+    std::function<void(Session*, uint16_t, uint32_t, uint32_t)> port_write_fallback;
+
+    ///
+    /// @brief Value for the guest to read, patched in the destination register once the `in` instruction
+    /// completed: (len, value to read)
+    ///
+    std::optional<std::pair<uint32_t, uint32_t>> pending_port_input {};
+
+    ///
+    /// @brief RIP of the instruction being executed, only tracked while the port reads are intercepted: `in`
+    /// and `ins` are told apart from its opcode when the port is read
+    ///
+    uint64_t instruction_rip {};
+
+    void
+    AttachPortDevice(uint16_t first, uint16_t last, std::shared_ptr<Devices::PortDevice> device);
+
+    bool
+    DetachPortDevice(uint16_t first, uint16_t last);
+
+    bool
+    HandlesPorts() const
+    {
+        return !port_table.empty() || port_read_fallback || port_write_fallback;
+    }
+
+    static constexpr size_t MaxExceptionVector = 32;
+
+    ///
+    /// @brief Native handling of the CPU exceptions, per vector
+    ///
+    std::array<ExceptionPolicy, MaxExceptionVector> exception_policies {};
+
+    ///
+    /// @brief Number of exceptions raised per vector, for the vectors with a counting policy
+    ///
+    std::array<uint64_t, MaxExceptionVector> exception_counts {};
+
+    ///
+    /// @brief Last exception counted: (vector, error code, rip, cr2)
+    ///
+    std::optional<std::tuple<uint32_t, uint32_t, uint64_t, uint64_t>> last_exception {};
+
+    ///
+    /// @brief Called with (session, vector, error_code) for the vectors with the `Python` policy
+    ///
+    std::function<void(Session*, uint32_t, uint32_t)> exception_handler;
+
+    ///
+    /// @brief Exception of the `Reinject` policy, raised again once the current one is delivered: raising it
+    /// from the exception hook itself would recurse. (vector, error code)
+    ///
+    std::optional<std::pair<uint32_t, uint32_t>> pending_exception {};
+
+    ///
+    /// @brief Set while the pending exception is raised, so it is not counted and reinjected again
+    ///
+    bool reinjecting {false};
+
+    bool
+    HandlesExceptions() const
+    {
+        return std::any_of(
+            exception_policies.begin(),
+            exception_policies.end(),
+            [](ExceptionPolicy p)
+            {
+                return p != ExceptionPolicy::Ignore;
+            });
+    }
+
+    ///
+    /// @brief Start address of the block being executed, and the instruction count when it was entered
+    ///
+    uint64_t current_block {0};
+    uint64_t current_block_mark {0};
+
+    ///
+    /// @brief Attribute the instructions executed since the last block entry to the current block, then enter
+    /// the block at `address`
+    ///
+    void
+    EnterBlock(uint64_t address)
+    {
+        if ( !block_profile.Capacity() )
+            return;
+
+        block_profile[current_block].instructions += executed_instructions - current_block_mark;
+        current_block      = address;
+        current_block_mark = executed_instructions;
+        block_profile[address].count++;
+    }
+
+    ///
+    /// @brief The compiled chain: `chain` points into `chain_hooks` and is null-terminated. Empty if it must
+    /// be rebuilt.
+    ///
+    std::vector<bochscpu_hooks_t> chain_hooks;
+    std::vector<bochscpu_hooks_t*> chain;
+    uint32_t chain_mask {0};
+
     const static inline size_t MaxAuxiliaryVariables = 16;
     std::function<void(uint64_t)> missing_page_handler;
     BochsCPU::Cpu::CPU cpu;
     std::array<uint64_t, MaxAuxiliaryVariables> auxiliaries;
+
+    ///
+    /// @brief Guest RIPs to break on, checked natively before each instruction is executed
+    ///
+    std::unordered_set<uint64_t> breakpoints;
+
+    ///
+    /// @brief If set, called when a breakpoint is hit; otherwise the execution is stopped
+    ///
+    std::function<void(Session*, uint64_t)> breakpoint_handler;
+
+    ///
+    /// @brief Set when a `run` resumes from `stopped_at`, so the breakpoint there doesn't trigger right away
+    ///
+    bool resuming {false};
+
+    ///
+    /// @brief RIP of the instruction the last `run` was stopped in front of, after hitting a breakpoint,
+    /// `until_rip` or an execute watchpoint there. Includes the stops requested by their handlers, but not
+    /// the data watchpoints, which stop after the accessing instruction.
+    ///
+    std::optional<uint64_t> stopped_at;
+
+    ///
+    /// @brief Number of instructions executed during the last `run`
+    ///
+    uint64_t executed_instructions {0};
+
+    ///
+    /// @brief If non-zero, stop the current `run` after that many instructions
+    ///
+    uint64_t max_instructions {0};
+
+    ///
+    /// @brief If set, stop the current `run` when this RIP is reached
+    ///
+    std::optional<uint64_t> until_rip {};
+
+    ///
+    /// @brief Why the last `run` stopped. Also set from the watchdog thread.
+    ///
+    std::atomic<StopReason> stop_reason {StopReason::Unknown};
+
+    ///
+    /// @brief AFL-style edge coverage map, filled natively from the branch events. Null if the coverage is
+    /// disabled, otherwise its size is a power of 2. Shared with the views handed out to Python, which keep
+    /// the map alive once it's replaced or disabled.
+    ///
+    std::shared_ptr<std::vector<uint8_t>> coverage;
+
+    ///
+    /// @brief Record the edge (src, dst) in the coverage map, if enabled
+    ///
+    void
+    RecordEdge(uint64_t src, uint64_t dst)
+    {
+        if ( !coverage )
+            return;
+
+        auto mix = [](uint64_t x) -> uint64_t
+        {
+            x ^= x >> 33;
+            x *= 0xff51afd7ed558ccdULL;
+            x ^= x >> 33;
+            return x;
+        };
+
+        std::vector<uint8_t>& map = *coverage;
+        uint8_t& hits             = map[(mix(src) ^ (mix(dst) >> 1)) & (map.size() - 1)];
+        if ( hits != 0xff )
+            hits++;
+    }
+
+    ///
+    /// @brief Native memory access trace, filled from the `lin_access` and `phy_access` events. Disabled
+    /// when its capacity is 0.
+    ///
+    RingBuffer<MemoryAccessRecord> memory_trace;
+
+    ///
+    /// @brief Number of memory accesses dropped because the trace was full and no handler was set
+    ///
+    uint64_t memory_trace_dropped {0};
+
+    ///
+    /// @brief If set, called with (session, records) whenever the memory trace is full, and when `run`
+    /// returns
+    ///
+    std::function<void(Session*, nb::object)> memory_trace_handler;
+
+    ///
+    /// @brief Record a memory access in the trace, flushing it to the handler if it is full
+    ///
+    void
+    RecordMemoryAccess(MemoryAccessRecord const& record);
+
+    ///
+    /// @brief Dequeue the content of the memory trace as a numpy structured array
+    ///
+    nb::object
+    DrainMemoryTrace();
+
+    ///
+    /// @brief Send the content of the memory trace to the handler, if any
+    ///
+    void
+    FlushMemoryTrace();
+
+    ///
+    /// @brief Watched guest linear memory ranges
+    ///
+    std::vector<Watchpoint> watchpoints;
+
+    ///
+    /// @brief If set, called with (session, address, len, access) when a watchpoint is hit; otherwise the
+    /// execution is stopped
+    ///
+    std::function<void(Session*, uint64_t, uint64_t, BochsCPU::Memory::Access)> watchpoint_handler;
+
+    ///
+    /// @brief Number of bits of the watched pages filter, indexed by the low bits of the page number
+    ///
+    static constexpr uint64_t WatchpointFilterBits = 1 << 16;
+
+    ///
+    /// @brief Watched pages filter: if the bit of a page is not set, no watchpoint covers that page. Empty
+    /// when there is no watchpoint.
+    ///
+    std::vector<uint64_t> watchpoint_pages;
+
+    ///
+    /// @brief Bit `n` is set if a watchpoint watches the `Memory::Access(n)` accesses
+    ///
+    uint32_t watchpoint_accesses {0};
+
+    void
+    AddWatchpoint(uint64_t start, uint64_t size, BochsCPU::Memory::Access access);
+
+    bool
+    RemoveWatchpoint(uint64_t start, uint64_t size);
+
+    void
+    ClearWatchpoints();
+
+    ///
+    /// @brief Rebuild the watched pages filter from the watchpoints
+    ///
+    void
+    RebuildWatchpointFilter();
+
+    ///
+    /// @brief Fast check against the watched pages filter: false if the access cannot hit a watchpoint
+    ///
+    bool
+    MayHitWatchpoint(uint64_t lin, uint64_t len) const
+    {
+        if ( watchpoint_pages.empty() )
+            return false;
+
+        auto test = [this](uint64_t page) -> bool
+        {
+            page &= WatchpointFilterBits - 1;
+            return (watchpoint_pages[page / 64] >> (page % 64)) & 1;
+        };
+
+        return test(lin >> 12) || test((lin + len - 1) >> 12);
+    }
+
+    ///
+    /// @brief Exact check of an access against the watchpoints, notifying the handler or stopping the
+    /// execution on a hit. `access` is the Bochs access type (read, write, execute or read-modify-write)
+    ///
+    /// @return true if a watchpoint was hit
+    ///
+    bool
+    CheckWatchpoints(uint64_t lin, uint64_t len, uint32_t access);
+
+    ///
+    /// @brief Set while `run` emulates with the GIL released, see `CheckNotRunning`
+    ///
+    std::atomic<bool> running {false};
+
+    ///
+    /// @brief Thread emulating while `running` is set
+    ///
+    std::thread::id run_thread {};
+
+    ///
+    /// @brief Throw if the session is running on another thread. The callbacks invoked by the run itself may
+    /// still change the session, as the emulation is suspended while they execute.
+    ///
+    void
+    CheckNotRunning() const
+    {
+        if ( running && std::this_thread::get_id() != run_thread )
+            throw std::runtime_error("The session can't be changed while it runs");
+    }
+
+    ///
+    /// @brief Throw if the session is running, even from its own callbacks. Used for changes that would free
+    /// something the emulation is still using, like the hook chain.
+    ///
+    void
+    CheckStopped() const
+    {
+        if ( running )
+            throw std::runtime_error("The session can't be changed while it runs");
+    }
+
+    ///
+    /// @brief Marks the session, and the hooks it runs, as running for its lifetime
+    ///
+    struct RunningScope
+    {
+        RunningScope(Session& session, std::vector<Hook*> const& extra);
+
+        ~RunningScope();
+
+        Session& m_Session;
+        std::vector<Hook*> m_Hooks;
+    };
+
+    ///
+    /// @brief Enforces the `timeout` of the runs, created on first use
+    ///
+    std::unique_ptr<Watchdog> watchdog;
+
+    ///
+    /// @brief Stop the execution, recording the reason
+    ///
+    void
+    Stop(StopReason reason)
+    {
+        stop_reason = reason;
+        ::bochscpu_cpu_stop(cpu.__cpu);
+    }
+
+    ///
+    /// @brief Stop the execution, unless it is already stopping for another reason
+    ///
+    void
+    StopIfUnstopped(StopReason reason)
+    {
+        StopReason expected = StopReason::Unknown;
+        if ( stop_reason.compare_exchange_strong(expected, reason) )
+            ::bochscpu_cpu_stop(cpu.__cpu);
+    }
 };
 
 
@@ -655,6 +1533,114 @@ struct Hook
     std::function<void(Session*, uint16_t, uintptr_t, unsigned)> outp;
     std::function<void(Session*, uint32_t, void*, uint8_t*, uintptr_t, bool, bool)> opcode;
     std::function<void(Session*, uint32_t, unsigned, unsigned)> exception;
+
+    ///
+    /// @brief If not empty, the execution, branch and linear access events are only delivered when their
+    /// address (respectively RIP, branch source and linear address) falls in one of those ranges
+    ///
+    AddressRangeSet ranges;
+
+    ///
+    /// @brief Events that can be delivered in batches, as they are purely informational
+    ///
+    static constexpr uint32_t BatchableEvents = (1 << (uint32_t)HookEvent::BeforeExecution) |
+                                                (1 << (uint32_t)HookEvent::AfterExecution) |
+                                                (1 << (uint32_t)HookEvent::RepeatIteration);
+
+    ///
+    /// @brief If non-zero, the `batch_events` are not delivered one by one to their callbacks, but
+    /// recorded natively and sent `batch_size` at a time to the `batch` callback.
+    ///
+    uint32_t batch_size {0};
+
+    ///
+    /// @brief Mask of the events to batch, a subset of `BatchableEvents`
+    ///
+    uint32_t batch_events {BatchableEvents};
+
+    ///
+    /// @brief Receives the batched events as (session, records)
+    ///
+    std::function<void(Session*, nb::object)> batch;
+
+    ///
+    /// @brief A batched event
+    ///
+    struct BatchRecord
+    {
+        uint64_t rip {};
+        uint32_t event {};
+        uint32_t cpu_id {};
+    };
+
+    ///
+    /// @brief Whether the given event must be delivered in batch
+    ///
+    bool
+    IsBatched(HookEvent e) const
+    {
+        return batch_size && batch && (batch_events & (1 << (uint32_t)e));
+    }
+
+    ///
+    /// @brief Record a batched event, flushing the batch if full
+    ///
+    void
+    RecordBatchEvent(HookContext& context, HookEvent e, uint32_t cpu_id);
+
+    ///
+    /// @brief Send the pending batched events to the `batch` callback
+    ///
+    void
+    FlushBatch(HookContext& context);
+
+    ///
+    /// @brief Get the events this hook subscribes to, i.e. the callbacks that are set. Bit `n` is set
+    /// if the callback for `HookEvent(n)` is defined.
+    ///
+    uint32_t
+    EventMask() const;
+
+    ///
+    /// @brief Populate a `bochscpu_hooks_t` with the trampolines for the callbacks this hook defines,
+    /// all the other entries being left to null so bochscpu skips them entirely.
+    ///
+    /// @return the event mask of the installed trampolines
+    ///
+    uint32_t
+    Install(bochscpu_hooks_t& hooks, HookContext& context);
+
+    ///
+    /// @brief Number of sessions currently running this hook
+    ///
+    std::atomic<uint32_t> running_sessions {0};
+
+    ///
+    /// @brief Throw if a session is running this hook: its trampolines read the callbacks, ranges and batch
+    /// settings without synchronization, and a callback can't replace itself while it executes.
+    ///
+    void
+    CheckNotRunning() const
+    {
+        if ( running_sessions )
+            throw std::runtime_error("The hook can't be changed while a session runs it");
+    }
+};
+
+
+///
+/// @brief Context given to the trampolines of a hook installed in the chain of a session. A hook can be
+/// installed in several sessions, so each installation has its own.
+///
+struct HookContext
+{
+    Session* session {};
+    Hook* hook {};
+
+    ///
+    /// @brief Pending batched events of the hook in this session
+    ///
+    std::vector<Hook::BatchRecord> batch_records;
 };
 
 
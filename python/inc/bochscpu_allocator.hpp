@@ -0,0 +1,251 @@
+#pragma once
+
+///
+/// @file bochscpu_allocator.hpp
+///
+/// @brief Host page allocator, and registry of the guest pages mapped through the memory module
+///
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <tuple>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+
+namespace BochsCPU::Memory
+{
+
+uintptr_t
+PageSize();
+
+uint64_t
+AlignAddressToPage(uint64_t va);
+
+
+///
+/// @brief Host page allocator: pages are carved from large, naturally aligned arenas instead of being mapped
+/// one by one, which keeps the number of syscalls and mappings low when loading large dumps. Freed pages are
+/// reused by the following allocations, and are always handed out zeroed. A page can be allocated on behalf of
+/// an owner (e.g. a session), in which case only that owner can free it.
+///
+class PageAllocator
+{
+public:
+    static constexpr uint64_t ArenaSize     = 2 * 1024 * 1024;
+    static constexpr uint64_t PagesPerArena = ArenaSize / 0x1000;
+
+    struct Arena
+    {
+        uint64_t base {};
+
+        ///
+        /// @brief Bit `n` is set if the page `n` is allocated
+        ///
+        std::array<uint64_t, PagesPerArena / 64> allocated {};
+
+        ///
+        /// @brief Number of allocated pages
+        ///
+        uint32_t used {};
+
+        ///
+        /// @brief Pages from this index onward were never handed out, and are still zero
+        ///
+        uint32_t watermark {};
+    };
+
+    static PageAllocator&
+    Instance();
+
+    ///
+    /// @brief Allocate a zeroed page, owned by `owner` if set
+    ///
+    /// @return the HVA of the page, 0 on failure
+    ///
+    uint64_t
+    Allocate(void const* owner = nullptr);
+
+    ///
+    /// @brief Release a page returned by `Allocate` for the same owner
+    ///
+    /// @return false if the page does not belong to the allocator, or to another owner
+    ///
+    bool
+    Free(uint64_t hva, void const* owner = nullptr);
+
+    size_t
+    Free(std::vector<uint64_t> const& hvas, void const* owner = nullptr);
+
+    ///
+    /// @brief Allocate a zeroed, contiguous host region of `size` bytes (rounded up to the page size) outside
+    /// of the arenas
+    ///
+    /// @return the HVA of the region, 0 on failure
+    ///
+    uint64_t
+    AllocateRange(uint64_t size);
+
+    ///
+    /// @brief Release a region returned by `AllocateRange`
+    ///
+    bool
+    FreeRange(uint64_t hva);
+
+    ///
+    /// @brief Statistics of the arenas, as (base, capacity, used, touched) tuples, the last three in pages
+    ///
+    std::vector<std::tuple<uint64_t, uint64_t, uint64_t, uint64_t>>
+    Arenas();
+
+private:
+    ///
+    /// @brief The arena bitmaps double as the ownership records, so a free is a lookup and a bit test
+    ///
+    bool
+    FreeLocked(uint64_t hva, void const* owner);
+
+    Arena*
+    CreateArena();
+
+    void
+    ReleaseArena(Arena* arena);
+
+    static uint64_t
+    ArenaKey(uint64_t hva)
+    {
+        return hva / ArenaSize;
+    }
+
+    std::mutex m_Lock;
+
+    ///
+    /// @brief The arenas, indexed by `ArenaKey`
+    ///
+    std::unordered_map<uint64_t, Arena> m_Arenas;
+
+    ///
+    /// @brief Keys of the arenas that may have a free page, checked lazily when allocating
+    ///
+    std::vector<uint64_t> m_Available;
+
+    ///
+    /// @brief The regions from `AllocateRange`, as base -> size
+    ///
+    std::unordered_map<uint64_t, uint64_t> m_Ranges;
+
+    ///
+    /// @brief Owners of the pages allocated on behalf of one, as HVA -> owner
+    ///
+    std::unordered_map<uint64_t, void const*> m_Owners;
+
+    ///
+    /// @brief An arena left empty is kept to absorb allocate/free cycles, further empty ones are released
+    ///
+    uint64_t m_EmptyArenas {};
+};
+
+
+///
+/// @brief Registry of the guest physical pages mapped through this module (GPA -> HVA), along with the pages
+/// written since the dirty tracking was last reset. Guest writes are reported by the sessions from the
+/// `lin_access` and `phy_access` events, host writes by the memory module functions (except through
+/// `phy_view`). Thread-safe, as the sessions may run on other threads.
+///
+class MappedPages
+{
+public:
+    static MappedPages&
+    Instance();
+
+    void
+    Insert(uint64_t gpa, uint8_t* hva);
+
+    void
+    Remove(uint64_t gpa);
+
+    ///
+    /// @return the HVA of the page of `gpa`, null if not mapped
+    ///
+    uint8_t*
+    Translate(uint64_t gpa) const;
+
+    ///
+    /// @brief Get a copy of the mapped pages, as GPA -> HVA
+    ///
+    std::unordered_map<uint64_t, uint8_t*>
+    Pages() const;
+
+    ///
+    /// @brief Start tracking the written pages on behalf of `owner` (non-zero), dropping the current dirty set
+    ///
+    void
+    TrackDirty(uint64_t owner);
+
+    ///
+    /// @return the owner given to the last `TrackDirty`, 0 if not tracking
+    ///
+    uint64_t
+    DirtyOwner() const
+    {
+        return m_DirtyOwner;
+    }
+
+    void
+    MarkDirty(uint64_t gpa, uint64_t len)
+    {
+        if ( !m_DirtyOwner || !len )
+            return;
+
+        //
+        // Consecutive writes mostly hit the same page, already in the dirty set: only a new page takes the lock
+        //
+        const uint64_t first = AlignAddressToPage(gpa);
+        const uint64_t last  = AlignAddressToPage(gpa + len - 1);
+        if ( first == last && first == m_LastDirty.load(std::memory_order_acquire) )
+            return;
+
+        std::lock_guard<std::mutex> lock(m_Lock);
+        for ( uint64_t page = first; page <= last; page += 0x1000 )
+            m_Dirty.insert(page);
+        m_LastDirty.store(last, std::memory_order_release);
+    }
+
+    ///
+    /// @brief Mark the pages behind the guest linear range [gva, gva + len) as dirty
+    ///
+    void
+    MarkDirty(uint64_t cr3, uint64_t gva, uint64_t len);
+
+    ///
+    /// @brief Get the dirty pages
+    ///
+    std::vector<uint64_t>
+    Dirty() const;
+
+    ///
+    /// @brief Get the dirty pages, and reset the dirty set
+    ///
+    std::vector<uint64_t>
+    TakeDirty();
+
+private:
+    mutable std::mutex m_Lock;
+    std::unordered_map<uint64_t, uint8_t*> m_Pages;
+    std::unordered_set<uint64_t> m_Dirty;
+
+    ///
+    /// @brief Read without the lock, to skip the tracking early
+    ///
+    std::atomic<uint64_t> m_DirtyOwner {};
+
+    ///
+    /// @brief Last page added to `m_Dirty`, read without the lock. Only stored once the page is in the set.
+    ///
+    std::atomic<uint64_t> m_LastDirty {~0ULL};
+};
+
+} // namespace BochsCPU::Memory
@@ -0,0 +1,159 @@
+#pragma once
+
+///
+/// @file bochscpu_devices.hpp
+///
+/// @brief Native I/O port devices, attached to the port ranges of a session
+///
+
+#include <array>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+
+namespace BochsCPU::Devices
+{
+
+///
+/// @brief A native I/O port device, bound to port ranges of a session
+///
+class PortDevice
+{
+public:
+    virtual ~PortDevice() = default;
+
+    virtual uint32_t
+    Read(uint16_t port, uint32_t len) = 0;
+
+    virtual void
+    Write(uint16_t port, uint32_t len, uint32_t value) = 0;
+};
+
+
+///
+/// @brief Always reads the same value, ignores the writes
+///
+class ConstantPort : public PortDevice
+{
+public:
+    ConstantPort(uint32_t value) : value {value}
+    {
+    }
+
+    uint32_t
+    Read(uint16_t, uint32_t) override
+    {
+        return value;
+    }
+
+    void
+    Write(uint16_t, uint32_t, uint32_t) override
+    {
+    }
+
+    uint32_t value;
+};
+
+
+///
+/// @brief Reads the last value written
+///
+class LatchPort : public PortDevice
+{
+public:
+    LatchPort(uint32_t value) : value {value}
+    {
+    }
+
+    uint32_t
+    Read(uint16_t, uint32_t) override
+    {
+        return value;
+    }
+
+    void
+    Write(uint16_t, uint32_t, uint32_t v) override
+    {
+        value = v;
+    }
+
+    uint32_t value;
+};
+
+
+///
+/// @brief Reads a counter incremented by `step` after every read, writes set the counter (e.g. a timer the
+/// guest polls)
+///
+class CounterPort : public PortDevice
+{
+public:
+    CounterPort(uint32_t value, uint32_t step) : value {value}, step {step}
+    {
+    }
+
+    uint32_t
+    Read(uint16_t, uint32_t) override
+    {
+        const uint32_t res = value;
+        value += step;
+        return res;
+    }
+
+    void
+    Write(uint16_t, uint32_t, uint32_t v) override
+    {
+        value = v;
+    }
+
+    uint32_t value;
+    uint32_t step;
+};
+
+
+///
+/// @brief Minimal 16550 UART: the transmitted bytes are captured, the received ones come from an input queue,
+/// and the line status always reports an empty transmitter. Bound to its 8 registers from `base`. The queues
+/// can be accessed from any thread while the guest uses the device.
+///
+class SerialPort : public PortDevice
+{
+public:
+    SerialPort(uint16_t base) : base {base}
+    {
+    }
+
+    uint32_t
+    Read(uint16_t port, uint32_t len) override;
+
+    void
+    Write(uint16_t port, uint32_t len, uint32_t value) override;
+
+    ///
+    /// @brief Get a copy of the transmitted bytes
+    ///
+    std::vector<uint8_t>
+    Output() const;
+
+    void
+    ClearOutput();
+
+    ///
+    /// @brief Queue bytes for the guest to receive
+    ///
+    void
+    Feed(uint8_t const* data, size_t size);
+
+    uint16_t base;
+
+private:
+    mutable std::mutex m_Lock;
+    std::vector<uint8_t> m_Output {};
+    std::vector<uint8_t> m_Input {};
+    size_t m_InputPosition {0};
+    std::array<uint8_t, 8> m_Registers {};
+    std::array<uint8_t, 2> m_Divisor {};
+};
+
+} // namespace BochsCPU::Devices
@@ -0,0 +1,29 @@
+#pragma once
+
+///
+/// @file bochscpu_log.hpp
+///
+/// @brief Logging macros of the bindings
+///
+
+#include <cstdio>
+
+// #define DEBUG
+
+#ifdef DEBUG
+#define dbg(fmt, ...) ::printf("[*] %s:%d - " fmt "\n", __FUNCTION__, __LINE__, __VA_ARGS__)
+#define info(fmt, ...) ::printf("[+] %s:%d - " fmt "\n", __FUNCTION__, __LINE__, __VA_ARGS__)
+#define warn(fmt, ...) ::printf("[!] %s:%d - " fmt "\n", __FUNCTION__, __LINE__, __VA_ARGS__)
+#define err(fmt, ...) ::printf("[-] %s:%d - " fmt "\n", __FUNCTION__, __LINE__, __VA_ARGS__)
+#else
+#define dbg(fmt, ...)
+#if defined(_WIN32)
+#define info(fmt, ...) ::printf("[+] " fmt "\n", __VA_ARGS__)
+#define warn(fmt, ...) ::printf("[!] " fmt "\n", __VA_ARGS__)
+#define err(fmt, ...) ::printf("[-] " fmt "\n", __VA_ARGS__)
+#elif defined(__LINUX__) || defined(__linux__) || defined(__APPLE__) || defined(__MACH__)
+#define info(fmt, ...) ::printf("[+] " fmt "\n" __VA_OPT__(, ) __VA_ARGS__)
+#define warn(fmt, ...) ::printf("[!] " fmt "\n" __VA_OPT__(, ) __VA_ARGS__)
+#define err(fmt, ...) ::printf("[-] " fmt "\n" __VA_OPT__(, ) __VA_ARGS__)
+#endif
+#endif // DEBUG
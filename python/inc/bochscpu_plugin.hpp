@@ -0,0 +1,68 @@
+#pragma once
+
+///
+/// @file bochscpu_plugin.hpp
+///
+/// @brief ABI of the native hook plugins loaded with `Session.load_native_hook(path, config)`.
+///
+/// A plugin is a shared library exporting `bochscpu_plugin_init`, and optionally `bochscpu_plugin_fini`:
+///
+/// ```cpp
+/// #include "bochscpu_plugin.hpp"
+///
+/// BOCHSCPU_PLUGIN_EXPORT int
+/// bochscpu_plugin_init(uint32_t abi_version, bochscpu_cpu_t cpu, const char* config, bochscpu_hooks_t* hooks)
+/// {
+///     if ( abi_version != BOCHSCPU_PLUGIN_ABI_VERSION )
+///         return -1;
+///     hooks->ctx              = new MyState {};
+///     hooks->before_execution = my_before_execution_cb;
+///     return 0;
+/// }
+///
+/// BOCHSCPU_PLUGIN_EXPORT void
+/// bochscpu_plugin_fini(void* ctx)
+/// {
+///     delete (MyState*)ctx;
+/// }
+/// ```
+///
+/// The hooks filled by `bochscpu_plugin_init` are chained after the session native features and before the
+/// Python hooks. They are invoked without the GIL, and must not call into Python.
+///
+
+#include <cstdint>
+
+#include "bochscpu/bochscpu.hpp"
+
+#define BOCHSCPU_PLUGIN_ABI_VERSION 1
+
+#define BOCHSCPU_PLUGIN_INIT_SYMBOL "bochscpu_plugin_init"
+#define BOCHSCPU_PLUGIN_FINI_SYMBOL "bochscpu_plugin_fini"
+
+#if defined(_WIN32)
+#define BOCHSCPU_PLUGIN_EXPORT extern "C" __declspec(dllexport)
+#else
+#define BOCHSCPU_PLUGIN_EXPORT extern "C" __attribute__((visibility("default")))
+#endif // _WIN32
+
+extern "C"
+{
+    ///
+    /// @brief Initialize the plugin for a CPU. `config` is the string given to `load_native_hook`, only valid
+    /// during the call. The plugin fills `hooks` (callbacks and `ctx`), which is zero-initialized.
+    ///
+    /// @return 0 on success, any other value aborts the loading
+    ///
+    typedef int (*bochscpu_plugin_init_t)(
+        uint32_t abi_version,
+        bochscpu_cpu_t cpu,
+        const char* config,
+        bochscpu_hooks_t* hooks);
+
+    ///
+    /// @brief Release the plugin resources, called with the `ctx` set by `bochscpu_plugin_init` when the
+    /// plugin is unloaded, or when its initialization failed after setting a `ctx`
+    ///
+    typedef void (*bochscpu_plugin_fini_t)(void* ctx);
+}
@@ -0,0 +1,464 @@
+#pragma once
+
+///
+/// @file bochscpu_profile.hpp
+///
+/// @brief Native containers of the sessions: the lock-free ring buffer, the address range set, and the block, call stack and function profilers
+///
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+
+namespace BochsCPU
+{
+
+///
+/// @brief Fixed-capacity single-producer/single-consumer queue. The emulator thread pushes, and a
+/// single consumer pops; neither side takes a lock.
+///
+template<typename T>
+class RingBuffer
+{
+public:
+    ///
+    /// @brief (Re-)allocate the buffer, discarding its content. `capacity` must be a power of 2, or 0 to
+    /// release the buffer.
+    ///
+    void
+    Reset(size_t capacity)
+    {
+        if ( capacity & (capacity - 1) )
+            throw std::invalid_argument("The ring buffer capacity must be a power of 2");
+        m_Items = std::vector<T>(capacity);
+        m_Head.store(0, std::memory_order_relaxed);
+        m_Tail.store(0, std::memory_order_relaxed);
+    }
+
+    ///
+    /// @brief Enqueue an item (producer side)
+    ///
+    /// @return false if the buffer is full
+    ///
+    bool
+    Push(T const& item)
+    {
+        const size_t tail = m_Tail.load(std::memory_order_relaxed);
+        if ( tail - m_Head.load(std::memory_order_acquire) == m_Items.size() )
+            return false;
+        m_Items[tail & (m_Items.size() - 1)] = item;
+        m_Tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    ///
+    /// @brief Dequeue all the items currently in the buffer into `out` (consumer side)
+    ///
+    /// @return the number of items dequeued
+    ///
+    size_t
+    PopAll(std::vector<T>& out)
+    {
+        const size_t head = m_Head.load(std::memory_order_relaxed);
+        const size_t tail = m_Tail.load(std::memory_order_acquire);
+        out.reserve(out.size() + (tail - head));
+        for ( size_t i = head; i != tail; i++ )
+            out.push_back(m_Items[i & (m_Items.size() - 1)]);
+        m_Head.store(tail, std::memory_order_release);
+        return tail - head;
+    }
+
+    size_t
+    Size() const
+    {
+        return m_Tail.load(std::memory_order_acquire) - m_Head.load(std::memory_order_acquire);
+    }
+
+    size_t
+    Capacity() const
+    {
+        return m_Items.size();
+    }
+
+private:
+    std::vector<T> m_Items {};
+    std::atomic<size_t> m_Head {0};
+    std::atomic<size_t> m_Tail {0};
+};
+
+
+///
+/// @brief Set of guest address ranges, kept as sorted and disjoint [start, end) intervals so that a lookup
+/// is a binary search.
+///
+class AddressRangeSet
+{
+public:
+    ///
+    /// @brief Add the range [start, end), merging it with the ranges it overlaps or touches
+    ///
+    void
+    Insert(uint64_t start, uint64_t end)
+    {
+        if ( start >= end )
+            throw std::invalid_argument("Invalid range");
+
+        auto first = std::lower_bound(
+            m_Ranges.begin(),
+            m_Ranges.end(),
+            start,
+            [](auto const& r, uint64_t addr)
+            {
+                return r.second < addr;
+            });
+        auto last = first;
+        while ( last != m_Ranges.end() && last->first <= end )
+        {
+            start = std::min(start, last->first);
+            end   = std::max(end, last->second);
+            last++;
+        }
+        first = m_Ranges.erase(first, last);
+        m_Ranges.insert(first, {start, end});
+    }
+
+    bool
+    Contains(uint64_t addr) const
+    {
+        auto it = std::upper_bound(
+            m_Ranges.begin(),
+            m_Ranges.end(),
+            addr,
+            [](uint64_t addr, auto const& r)
+            {
+                return addr < r.first;
+            });
+        return it != m_Ranges.begin() && addr < std::prev(it)->second;
+    }
+
+    bool
+    Empty() const
+    {
+        return m_Ranges.empty();
+    }
+
+    void
+    Clear()
+    {
+        m_Ranges.clear();
+    }
+
+    std::vector<std::pair<uint64_t, uint64_t>> const&
+    Ranges() const
+    {
+        return m_Ranges;
+    }
+
+private:
+    std::vector<std::pair<uint64_t, uint64_t>> m_Ranges {};
+};
+
+
+///
+/// @brief Execution counters of a basic block
+///
+struct BlockRecord
+{
+    uint64_t address {};
+    uint64_t count {};
+    uint64_t instructions {};
+};
+
+
+///
+/// @brief Open-addressing (linear probing) hash map of basic block counters, keyed by the block start address
+///
+class BlockCounter
+{
+public:
+    static constexpr uint64_t EmptySlot = ~0ULL;
+
+    ///
+    /// @brief Drop all the counters, and set the initial capacity (a power of 2, or 0 to disable)
+    ///
+    void
+    Reset(size_t capacity)
+    {
+        if ( capacity & (capacity - 1) )
+            throw std::invalid_argument("The capacity must be a power of 2");
+        m_Slots.assign(capacity, BlockRecord {.address = EmptySlot});
+        m_Size = 0;
+    }
+
+    size_t
+    Capacity() const
+    {
+        return m_Slots.size();
+    }
+
+    size_t
+    Size() const
+    {
+        return m_Size;
+    }
+
+    ///
+    /// @brief Get the counters of the block at `address`, inserting them if needed
+    ///
+    BlockRecord&
+    operator[](uint64_t address)
+    {
+        //
+        // Keep the load factor under 3/4 so probing sequences stay short
+        //
+        if ( (m_Size + 1) * 4 > m_Slots.size() * 3 )
+            Grow();
+
+        BlockRecord* slot = Find(address);
+        if ( slot->address == EmptySlot )
+        {
+            slot->address = address;
+            m_Size++;
+        }
+        return *slot;
+    }
+
+    ///
+    /// @brief Get the used slots
+    ///
+    std::vector<BlockRecord>
+    Records() const
+    {
+        std::vector<BlockRecord> records;
+        records.reserve(m_Size);
+        for ( auto const& slot : m_Slots )
+            if ( slot.address != EmptySlot )
+                records.push_back(slot);
+        return records;
+    }
+
+private:
+    BlockRecord*
+    Find(uint64_t address)
+    {
+        const size_t mask = m_Slots.size() - 1;
+        size_t idx        = (address * 0x9e3779b97f4a7c15ULL) >> 32;
+        while ( true )
+        {
+            BlockRecord& slot = m_Slots[idx & mask];
+            if ( slot.address == address || slot.address == EmptySlot )
+                return &slot;
+            idx++;
+        }
+    }
+
+    void
+    Grow()
+    {
+        std::vector<BlockRecord> old = std::move(m_Slots);
+        m_Slots.assign(std::max<size_t>(old.size() * 2, 16), BlockRecord {.address = EmptySlot});
+        for ( auto const& slot : old )
+            if ( slot.address != EmptySlot )
+                *Find(slot.address) = slot;
+    }
+
+    std::vector<BlockRecord> m_Slots {};
+    size_t m_Size {0};
+};
+
+
+///
+/// @brief A frame of the shadow call stack
+///
+struct ShadowFrame
+{
+    uint64_t call_site {};
+    uint64_t target {};
+    uint64_t return_address {};
+    uint64_t stack_pointer {};
+};
+
+
+///
+/// @brief Shadow call stack, maintained from the near call and return events.
+///
+/// Returns are matched on their target, so a `ret` skipping frames (longjmp, exception unwinding) drops all
+/// the frames above the matching one. Frames whose return slot is below the stack pointer are dead and are
+/// discarded lazily, unless the stack pointer moved too far away from them (stack pivot, context switch).
+///
+class ShadowStack
+{
+public:
+    static constexpr size_t DefaultMaxDepth       = 4096;
+    static constexpr uint64_t StackPivotThreshold = 0x100000;
+
+    void
+    Reset(size_t max_depth)
+    {
+        m_Frames.clear();
+        m_MaxDepth = max_depth;
+        m_Frames.reserve(max_depth);
+    }
+
+    bool
+    Enabled() const
+    {
+        return m_MaxDepth != 0;
+    }
+
+    ///
+    /// @brief Get the return address of a call from the value pushed on the stack: it follows the call
+    /// instruction (at most 15 bytes), which also tells the operand size
+    ///
+    static uint64_t
+    ReturnAddress(uint64_t call_site, uint64_t stack_value)
+    {
+        for ( uint64_t mask : {~0ULL, 0xffffffffULL, 0xffffULL} )
+        {
+            if ( (stack_value & mask) > call_site && (stack_value & mask) - call_site <= 15 )
+                return stack_value & mask;
+        }
+        return stack_value;
+    }
+
+    ///
+    /// @brief Record a call from `call_site` to `target`, after the return address `stack_value` was pushed at
+    /// `stack_pointer`
+    ///
+    void
+    Call(uint64_t call_site, uint64_t target, uint64_t stack_pointer, uint64_t stack_value);
+
+    ///
+    /// @brief Record a return to `target`, the stack pointer being `stack_pointer` after the return
+    ///
+    void
+    Return(uint64_t target, uint64_t stack_pointer);
+
+    std::vector<ShadowFrame> const&
+    Frames() const
+    {
+        return m_Frames;
+    }
+
+private:
+    void
+    DiscardDeadFrames(uint64_t stack_pointer, bool inclusive);
+
+    std::vector<ShadowFrame> m_Frames {};
+    size_t m_MaxDepth {0};
+};
+
+
+///
+/// @brief A node of the function profiler call tree: a function, reached through the call path of its parents
+///
+struct ProfileNode
+{
+    uint64_t function {};
+    uint32_t parent {};
+    uint64_t calls {};
+    uint64_t self_instructions {};
+};
+
+
+///
+/// @brief Function-level profiler: attributes the executed instructions to the nodes of a call tree built
+/// from the near call and return events. Node 0 is the root.
+///
+class FunctionProfiler
+{
+public:
+    ///
+    /// @brief Depth of the call paths: deeper calls, or calls that never return, are attributed to the
+    /// function at that depth
+    ///
+    static constexpr size_t MaxDepth = 4096;
+
+    void
+    Reset(bool enabled);
+
+    bool
+    Enabled() const
+    {
+        return m_Enabled;
+    }
+
+    ///
+    /// @brief Start attributing the instructions to the function at `rip`, reached from the root
+    ///
+    void
+    Begin(uint64_t rip, uint64_t executed_instructions);
+
+    void
+    End(uint64_t executed_instructions);
+
+    void
+    Call(uint64_t target, uint64_t return_address, uint64_t executed_instructions);
+
+    void
+    Return(uint64_t target, uint64_t executed_instructions);
+
+    std::vector<ProfileNode> const&
+    Nodes() const
+    {
+        return m_Nodes;
+    }
+
+    ///
+    /// @brief Get the inclusive instruction count of every node (itself and its callees)
+    ///
+    std::vector<uint64_t>
+    InclusiveInstructions() const;
+
+    ///
+    /// @brief Aggregate the nodes per function, as (function, calls, self, inclusive) tuples sorted by
+    /// decreasing inclusive count. Recursive calls are only counted once in the inclusive count.
+    ///
+    std::vector<std::tuple<uint64_t, uint64_t, uint64_t, uint64_t>>
+    Functions() const;
+
+    ///
+    /// @brief Export the self counts in the folded stacks format ("root;f1;f2 count" lines) used by the
+    /// flamegraph tools. Functions are named from `symbols`, or by their address.
+    ///
+    std::string
+    Folded(std::unordered_map<uint64_t, std::string> const& symbols) const;
+
+private:
+    uint32_t
+    Child(uint32_t parent, uint64_t function);
+
+    void
+    Account(uint64_t executed_instructions)
+    {
+        m_Nodes[m_Current].self_instructions += executed_instructions - m_Mark;
+        m_Mark = executed_instructions;
+    }
+
+    struct ChildKeyHash
+    {
+        size_t
+        operator()(std::pair<uint32_t, uint64_t> const& key) const
+        {
+            return std::hash<uint64_t> {}(key.second * 0x9e3779b97f4a7c15ULL ^ key.first);
+        }
+    };
+
+    bool m_Enabled {false};
+    std::vector<ProfileNode> m_Nodes {};
+    std::unordered_map<std::pair<uint32_t, uint64_t>, uint32_t, ChildKeyHash> m_Children {};
+    std::vector<std::pair<uint32_t, uint64_t>> m_Stack {};
+    uint32_t m_Current {0};
+    uint64_t m_Mark {0};
+};
+
+} // namespace BochsCPU
@@ -0,0 +1,40 @@
+#pragma once
+
+///
+/// @file bochscpu_snapshot.hpp
+///
+/// @brief Snapshots of the CPU state and of the guest memory
+///
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "bochscpu/bochscpu.hpp"
+
+
+namespace BochsCPU
+{
+
+///
+/// @brief Snapshot of the CPU state and of the content of the mapped guest pages, see `Session::TakeSnapshot`
+///
+struct Snapshot
+{
+    ///
+    /// @brief Unique identifier, owning the dirty tracking of `MappedPages` while this snapshot is the latest
+    /// taken or restored
+    ///
+    uint64_t id {};
+
+    State state {};
+
+    ///
+    /// @brief GPA of each page -> offset of its content in `pages`
+    ///
+    std::unordered_map<uint64_t, size_t> index;
+
+    std::vector<uint8_t> pages;
+};
+
+} // namespace BochsCPU
@@ -0,0 +1,179 @@
+#pragma once
+
+///
+/// @file bochscpu_trace.hpp
+///
+/// @brief Compressed control-flow tracer
+///
+
+#include <array>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+
+#if defined(_WIN32)
+#include <windows.h>
+#endif // _WIN32
+
+
+namespace BochsCPU
+{
+
+///
+/// @brief Compressed control-flow trace, streamed to a file.
+///
+/// The file starts with a 16-byte header (`ControlFlowTracer::Magic`, then the u32 version and a reserved
+/// u32), followed by a stream of packets, similar to Intel PT:
+///  - `0x00`: padding
+///  - TNT (even byte): up to 6 conditional branch outcomes (1 = taken), from the bit below the highest set
+///    bit (oldest) down to bit 1
+///  - `0x01` TIP: indirect branch target, as a LEB128 of `target ^ last_ip`
+///  - `0x03` START: full RIP the execution starts from, as a LEB128
+///  - `0x05` FAR: far branch (including interrupts and exceptions), the u16 CS then the target as for TIP
+///  - `0x07` END: end of a run, followed by the LEB128 number of executed instructions
+///
+/// The packets are written directly into a mapped window of the file, while a background thread maps the
+/// next window and unmaps the full ones. If that fails, the following packets are dropped and the error is
+/// raised by `End` and `Close`.
+///
+class ControlFlowTracer
+{
+public:
+    static constexpr char Magic[8]            = {'B', 'X', 'C', 'F', 'T', 'R', 'C', '\0'};
+    static constexpr uint32_t Version         = 1;
+    static constexpr size_t DefaultWindowSize = 1 << 20;
+
+    enum class Packet : uint8_t
+    {
+        Pad   = 0x00,
+        Tip   = 0x01,
+        Start = 0x03,
+        Far   = 0x05,
+        End   = 0x07,
+    };
+
+    ControlFlowTracer(std::string const& path, size_t window_size);
+
+    ~ControlFlowTracer();
+
+    void
+    Begin(uint64_t rip);
+
+    ///
+    /// @brief Emit the END packet of a run, then raise the error of the writer thread if any
+    ///
+    void
+    End(uint64_t executed_instructions);
+
+    void
+    Branch(bool taken)
+    {
+        m_Tnt = (m_Tnt << 1) | (taken ? 1 : 0);
+        if ( ++m_TntCount == 6 )
+            FlushTnt();
+    }
+
+    void
+    IndirectBranch(uint64_t target);
+
+    void
+    FarBranch(uint16_t cs, uint64_t target);
+
+    ///
+    /// @brief Flush the pending packets, stop the writer thread and truncate the file to the trace size, then
+    /// raise the error of the writer thread if any
+    ///
+    void
+    Close();
+
+    ///
+    /// @brief Number of bytes of the trace, including the header
+    ///
+    uint64_t
+    Size() const
+    {
+        return m_Windows[m_Active].offset + m_Position;
+    }
+
+    std::string const&
+    Path() const
+    {
+        return m_Path;
+    }
+
+private:
+    struct Window
+    {
+        uint8_t* base {};
+        uint64_t offset {};
+        bool ready {};
+    };
+
+    void
+    Emit(uint8_t byte)
+    {
+        if ( m_Position == m_WindowSize && !Rotate() )
+            return;
+        m_Windows[m_Active].base[m_Position++] = byte;
+    }
+
+    void
+    EmitVarint(uint64_t value);
+
+    void
+    FlushTnt();
+
+    ///
+    /// @brief Switch to the next window
+    ///
+    /// @return false if the writer thread failed to map it, in which case the trace stays full
+    ///
+    bool
+    Rotate();
+
+    void
+    WriterThread();
+
+    void
+    RaiseWriterError();
+
+    uint8_t*
+    MapWindow(uint64_t offset);
+
+    void
+    UnmapWindow(uint8_t* base);
+
+    std::string m_Path;
+    size_t m_WindowSize;
+#if defined(_WIN32)
+    HANDLE m_File {INVALID_HANDLE_VALUE};
+#else
+    int m_File {-1};
+#endif // _WIN32
+    std::array<Window, 2> m_Windows {};
+    size_t m_Active {0};
+    size_t m_Position {0};
+    uint64_t m_NextOffset {0};
+    uint64_t m_LastIp {0};
+    uint8_t m_Tnt {0};
+    uint8_t m_TntCount {0};
+
+    std::thread m_Writer;
+    std::mutex m_Lock;
+    std::condition_variable m_Cond;
+    std::optional<size_t> m_Retired {};
+    bool m_Stopping {false};
+    bool m_Closed {false};
+
+    ///
+    /// @brief Error of the writer thread, which then exits
+    ///
+    std::exception_ptr m_Error {};
+    bool m_Failed {false};
+};
+
+} // namespace BochsCPU
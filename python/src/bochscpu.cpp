@@ -1,9 +1,17 @@
 #include "bochscpu.hpp"
 
 #include <nanobind/nanobind.h>
+#include <nanobind/ndarray.h>
 #include <nanobind/stl/array.h>
 #include <nanobind/stl/function.h>
 #include <nanobind/stl/list.h>
+#include <nanobind/stl/optional.h>
+#include <nanobind/stl/pair.h>
+#include <nanobind/stl/shared_ptr.h>
+#include <nanobind/stl/string.h>
+#include <nanobind/stl/tuple.h>
+#include <nanobind/stl/unordered_map.h>
+#include <nanobind/stl/unordered_set.h>
 #include <nanobind/stl/vector.h>
 
 #include <string>
@@ -12,7 +20,40 @@
 namespace nb = nanobind;
 using namespace nb::literals;
 
-#define MAX_HOOKS 16
+
+template<typename M>
+struct MemberTraits;
+
+template<typename C, typename F>
+struct MemberTraits<F C::*>
+{
+    using Class = C;
+    using Field = F;
+};
+
+///
+/// @brief Property getter of a session or hook field
+///
+template<auto Member>
+static typename MemberTraits<decltype(Member)>::Field
+Get(typename MemberTraits<decltype(Member)>::Class const& self)
+{
+    return self.*Member;
+}
+
+///
+/// @brief Property setter of a session or hook field, refused while the object is running
+///
+template<auto Member>
+static void
+GuardedSet(typename MemberTraits<decltype(Member)>::Class& self, typename MemberTraits<decltype(Member)>::Field value)
+{
+    self.CheckNotRunning();
+    self.*Member = std::move(value);
+}
+
+#define DEF_GUARDED_RW(Class, Name, ...) def_prop_rw(#Name, &Get<&Class::Name>, &GuardedSet<&Class::Name>, __VA_ARGS__)
+
 
 
 void
@@ -28,6 +69,25 @@ bochscpu_tp_traverse(PyObject* self, visitproc visit, void* arg)
     BochsCPU::Session* sess = nb::inst_ptr<BochsCPU::Session>(self);
     nb::object value        = nb::find(sess->missing_page_handler);
     Py_VISIT(value.ptr());
+    nb::object bp_handler = nb::find(sess->breakpoint_handler);
+    Py_VISIT(bp_handler.ptr());
+    nb::object mt_handler = nb::find(sess->memory_trace_handler);
+    Py_VISIT(mt_handler.ptr());
+    nb::object pr_handler = nb::find(sess->port_read_fallback);
+    Py_VISIT(pr_handler.ptr());
+    nb::object pw_handler = nb::find(sess->port_write_fallback);
+    Py_VISIT(pw_handler.ptr());
+    nb::object ex_handler = nb::find(sess->exception_handler);
+    Py_VISIT(ex_handler.ptr());
+    nb::object wp_handler = nb::find(sess->watchpoint_handler);
+    Py_VISIT(wp_handler.ptr());
+    for ( auto const& r : sess->registered_hooks )
+        Py_VISIT(r.owner.ptr());
+    for ( auto const& [number, handler] : sess->syscall_handlers )
+    {
+        nb::object sc_handler = nb::find(handler);
+        Py_VISIT(sc_handler.ptr());
+    }
     return 0;
 }
 
@@ -37,6 +97,14 @@ bochscpu_tp_clear(PyObject* self)
     dbg("clearing PF handler");
     BochsCPU::Session* sess    = nb::inst_ptr<BochsCPU::Session>(self);
     sess->missing_page_handler = nullptr;
+    sess->breakpoint_handler   = nullptr;
+    sess->memory_trace_handler = nullptr;
+    sess->watchpoint_handler   = nullptr;
+    sess->ClearHooks();
+    sess->syscall_handlers.clear();
+    sess->port_read_fallback   = nullptr;
+    sess->port_write_fallback  = nullptr;
+    sess->exception_handler    = nullptr;
     return 0;
 }
 
@@ -122,6 +190,43 @@ NB_MODULE(_bochscpu, m)
         .export_values();
 
 
+    nb::enum_<BochsCPU::StopReason>(m, "StopReason", "Class StopReason")
+        .value("Unknown", BochsCPU::StopReason::Unknown, "The execution was not stopped by the session")
+        .value("Requested", BochsCPU::StopReason::Requested, "`Session.stop()` was called")
+        .value("Breakpoint", BochsCPU::StopReason::Breakpoint, "A breakpoint was hit")
+        .value("InstructionLimit", BochsCPU::StopReason::InstructionLimit, "The instruction budget was exhausted")
+        .value("UntilRip", BochsCPU::StopReason::UntilRip, "The `until_rip` address was reached")
+        .value("Watchpoint", BochsCPU::StopReason::Watchpoint, "A watchpoint was hit")
+        .value("Syscall", BochsCPU::StopReason::Syscall, "A syscall was intercepted with the `Stop` policy")
+        .value("Exception", BochsCPU::StopReason::Exception, "An exception was raised with the `Stop` policy")
+        .value("Timeout", BochsCPU::StopReason::Timeout, "The `timeout` of the run expired");
+
+
+    nb::enum_<BochsCPU::ExceptionPolicy>(m, "ExceptionPolicy", "Class ExceptionPolicy")
+        .value("Ignore", BochsCPU::ExceptionPolicy::Ignore, "Nothing is done natively")
+        .value("Count", BochsCPU::ExceptionPolicy::Count, "The exception is counted")
+        .value("Stop", BochsCPU::ExceptionPolicy::Stop, "The exception is counted, then the execution stops")
+        .value(
+            "Reinject",
+            BochsCPU::ExceptionPolicy::Reinject,
+            "The exception is counted, then raised again with `bochscpu_cpu_set_exception` before the next "
+            "instruction")
+        .value(
+            "Python",
+            BochsCPU::ExceptionPolicy::Python,
+            "The exception is counted, then `Session.exception_handler` is called");
+
+
+    nb::enum_<BochsCPU::SyscallPolicy>(m, "SyscallPolicy", "Class SyscallPolicy")
+        .value("Ignore", BochsCPU::SyscallPolicy::Ignore, "The syscalls are neither intercepted nor counted")
+        .value("Count", BochsCPU::SyscallPolicy::Count, "The syscalls are counted, then handled by the guest kernel")
+        .value("Stop", BochsCPU::SyscallPolicy::Stop, "The syscalls are counted, then the execution stops")
+        .value(
+            "Skip",
+            BochsCPU::SyscallPolicy::Skip,
+            "The syscalls are counted, then returned from with `Session.syscall_skip_value`");
+
+
     nb::enum_<BochsCPU::HookType>(m, "HookType", "Class HookType")
         .value("MEM_READ", BochsCPU::HookType::BOCHSCPU_HOOK_MEM_READ, "Constant value for BOCHSCPU_HOOK_MEM_READ")
         .value("MEM_WRITE", BochsCPU::HookType::BOCHSCPU_HOOK_MEM_WRITE, "Constant value for BOCHSCPU_HOOK_MEM_WRITE")
@@ -172,40 +277,165 @@ NB_MODULE(_bochscpu, m)
         .export_values();
 
 
+    {
+        auto e = nb::enum_<BochsCPU::HookEvent>(m, "HookEvent", "Class HookEvent");
+#define X(field, name) e.value(#name, BochsCPU::HookEvent::name, "Bit index of the `" #field "` event in a hook mask");
+        BOCHSCPU_FOREACH_HOOK_EVENT(X)
+#undef X
+    }
+
+
+    nb::class_<BochsCPU::Devices::PortDevice>(m, "PortDevice", "Base class of the native I/O port devices");
+
+    nb::class_<BochsCPU::Devices::ConstantPort, BochsCPU::Devices::PortDevice>(
+        m,
+        "ConstantPort",
+        "Port device always reading the same value, and ignoring the writes")
+        .def(nb::init<uint32_t>(), "value"_a)
+        .def_rw("value", &BochsCPU::Devices::ConstantPort::value);
+
+    nb::class_<BochsCPU::Devices::LatchPort, BochsCPU::Devices::PortDevice>(
+        m,
+        "LatchPort",
+        "Port device reading the last value written")
+        .def(nb::init<uint32_t>(), "value"_a = 0)
+        .def_rw("value", &BochsCPU::Devices::LatchPort::value);
+
+    nb::class_<BochsCPU::Devices::CounterPort, BochsCPU::Devices::PortDevice>(
+        m,
+        "CounterPort",
+        "Port device reading a counter incremented by `step` after every read, the writes set the counter")
+        .def(nb::init<uint32_t, uint32_t>(), "value"_a = 0, "step"_a = 1)
+        .def_rw("value", &BochsCPU::Devices::CounterPort::value)
+        .def_rw("step", &BochsCPU::Devices::CounterPort::step);
+
+    nb::class_<BochsCPU::Devices::SerialPort, BochsCPU::Devices::PortDevice>(
+        m,
+        "SerialPort",
+        "Minimal 16550 UART capturing the transmitted bytes, to attach to its 8 ports from `base`")
+        .def(nb::init<uint16_t>(), "base"_a = 0x3f8)
+        .def_ro("base", &BochsCPU::Devices::SerialPort::base)
+        .def_prop_ro(
+            "output",
+            [](BochsCPU::Devices::SerialPort const& p)
+            {
+                const std::vector<uint8_t> output = p.Output();
+                return nb::bytes((const char*)output.data(), output.size());
+            },
+            "Get the bytes transmitted by the guest")
+        .def(
+            "clear_output",
+            [](BochsCPU::Devices::SerialPort& p)
+            {
+                p.ClearOutput();
+            },
+            "Discard the bytes transmitted by the guest")
+        .def(
+            "feed",
+            [](BochsCPU::Devices::SerialPort& p, nb::bytes data)
+            {
+                p.Feed((const uint8_t*)data.c_str(), data.size());
+            },
+            "data"_a,
+            "Queue bytes for the guest to receive");
+
+
     nb::class_<BochsCPU::Hook>(m, "Hook", "Class Hook")
         .def(nb::init<>())
-        .def_rw("ctx", &BochsCPU::Hook::ctx, "A raw pointer to the Session object")
-        .def_rw("reset", &BochsCPU::Hook::reset, "Callback for Bochs `reset` callback")
-        .def_rw("hlt", &BochsCPU::Hook::hlt, "Callback for Bochs `hlt` callback")
-        .def_rw("mwait", &BochsCPU::Hook::mwait, "Callback for Bochs `mwait` callback")
-        .def_rw(
-            "cnear_branch_taken",
-            &BochsCPU::Hook::cnear_branch_taken,
-            "Callback for Bochs `cnear_branch_taken` callback")
-        .def_rw(
-            "cnear_branch_not_taken",
-            &BochsCPU::Hook::cnear_branch_not_taken,
-            "Callback for Bochs `cnear_branch_not_taken` callback")
-        .def_rw("ucnear_branch", &BochsCPU::Hook::ucnear_branch, "Callback for Bochs `ucnear_branch` callback")
-        .def_rw("far_branch", &BochsCPU::Hook::far_branch, "Callback for Bochs `far_branch` callback")
-        .def_rw("vmexit", &BochsCPU::Hook::vmexit, "Callback for Bochs `vmexit` callback")
-        .def_rw("interrupt", &BochsCPU::Hook::interrupt, "Callback for Bochs `interrupt` callback")
-        .def_rw("exception", &BochsCPU::Hook::exception, "Callback for Bochs `exception` callback")
-        .def_rw("hw_interrupt", &BochsCPU::Hook::hw_interrupt, "Callback for Bochs `hw_interrupt` callback")
-        .def_rw("tlb_cntrl", &BochsCPU::Hook::tlb_cntrl, "Callback for Bochs `tlb_cntrl` callback")
-        .def_rw("cache_cntrl", &BochsCPU::Hook::cache_cntrl, "Callback for Bochs `cache_cntrl` callback")
-        .def_rw("prefetch_hint", &BochsCPU::Hook::prefetch_hint, "Callback for Bochs `prefetch_hint` callback")
-        .def_rw("clflush", &BochsCPU::Hook::clflush, "Callback for Bochs `clflush` callback")
-        .def_rw("before_execution", &BochsCPU::Hook::before_execution, "Callback for Bochs `before_execution` callback")
-        .def_rw("after_execution", &BochsCPU::Hook::after_execution, "Callback for Bochs `after_execution` callback")
-        .def_rw("repeat_iteration", &BochsCPU::Hook::repeat_iteration, "Callback for Bochs `repeat_iteration` callback")
-        .def_rw("lin_access", &BochsCPU::Hook::lin_access, "Callback for Bochs `lin_access` callback")
-        .def_rw("phy_access", &BochsCPU::Hook::phy_access, "Callback for Bochs `phy_access` callback")
-        .def_rw("wrmsr", &BochsCPU::Hook::wrmsr, "Callback for Bochs `wrmsr` callback")
-        .def_rw("opcode", &BochsCPU::Hook::opcode, "Callback for Bochs `opcode` callback")
-        .def_rw("inp", &BochsCPU::Hook::inp, "Callback for Bochs `inp` callback")
-        .def_rw("inp2", &BochsCPU::Hook::inp2, "Callback for Bochs `inp2` callback")
-        .def_rw("outp", &BochsCPU::Hook::outp, "Callback for Bochs `outp` callback");
+        .DEF_GUARDED_RW(
+            BochsCPU::Hook,
+            ctx,
+            "A user-defined pointer, left untouched by the sessions: the callbacks get their session as first argument")
+        .def_prop_ro(
+            "event_mask",
+            &BochsCPU::Hook::EventMask,
+            "Get the mask of the events the hook subscribes to: bit `n` is set if the callback for `HookEvent(n)` "
+            "is defined. Only those events will be dispatched by the emulator")
+        .def(
+            "has_event",
+            [](BochsCPU::Hook const& h, BochsCPU::HookEvent e)
+            {
+                return (h.EventMask() & (1 << (uint32_t)e)) != 0;
+            },
+            "event"_a,
+            "Indicates whether the hook subscribes to the given event")
+        .DEF_GUARDED_RW(
+            BochsCPU::Hook,
+            batch_size,
+            "Get/Set the batch size. If non-zero and `batch` is set, the `batch_events` are recorded natively and "
+            "delivered `batch_size` at a time to `batch` instead of their own callbacks")
+        .def_prop_rw(
+            "batch_events",
+            [](BochsCPU::Hook const& h)
+            {
+                return h.batch_events;
+            },
+            [](BochsCPU::Hook& h, uint32_t mask)
+            {
+                h.CheckNotRunning();
+                if ( mask & ~BochsCPU::Hook::BatchableEvents )
+                    throw std::invalid_argument(
+                        "Only the BeforeExecution, AfterExecution and RepeatIteration events can be batched");
+                h.batch_events = mask;
+            },
+            "Get/Set the mask of the events to batch (by default BeforeExecution, AfterExecution and "
+            "RepeatIteration)")
+        .DEF_GUARDED_RW(
+            BochsCPU::Hook,
+            batch,
+            "Callback for the batched events, invoked with (session, records) where records is a numpy structured "
+            "array with the fields `rip`, `event` (a `HookEvent` value) and `cpu_id`")
+        .def(
+            "add_range",
+            [](BochsCPU::Hook& h, uint64_t start, uint64_t end)
+            {
+                h.CheckNotRunning();
+                h.ranges.Insert(start, end);
+            },
+            "start"_a,
+            "end"_a,
+            "Restrict the execution, branch and linear access callbacks to the guest addresses in [start, end). "
+            "Overlapping ranges are merged")
+        .def(
+            "clear_ranges",
+            [](BochsCPU::Hook& h)
+            {
+                h.CheckNotRunning();
+                h.ranges.Clear();
+            },
+            "Remove all the address ranges, the callbacks are then invoked for any address")
+        .def_prop_ro(
+            "ranges",
+            [](BochsCPU::Hook const& h)
+            {
+                return h.ranges.Ranges();
+            },
+            "Get the sorted list of (start, end) address ranges the hook is restricted to")
+        .DEF_GUARDED_RW(BochsCPU::Hook, reset, "Callback for Bochs `reset` callback")
+        .DEF_GUARDED_RW(BochsCPU::Hook, hlt, "Callback for Bochs `hlt` callback")
+        .DEF_GUARDED_RW(BochsCPU::Hook, mwait, "Callback for Bochs `mwait` callback")
+        .DEF_GUARDED_RW(BochsCPU::Hook, cnear_branch_taken, "Callback for Bochs `cnear_branch_taken` callback")
+        .DEF_GUARDED_RW(BochsCPU::Hook, cnear_branch_not_taken, "Callback for Bochs `cnear_branch_not_taken` callback")
+        .DEF_GUARDED_RW(BochsCPU::Hook, ucnear_branch, "Callback for Bochs `ucnear_branch` callback")
+        .DEF_GUARDED_RW(BochsCPU::Hook, far_branch, "Callback for Bochs `far_branch` callback")
+        .DEF_GUARDED_RW(BochsCPU::Hook, vmexit, "Callback for Bochs `vmexit` callback")
+        .DEF_GUARDED_RW(BochsCPU::Hook, interrupt, "Callback for Bochs `interrupt` callback")
+        .DEF_GUARDED_RW(BochsCPU::Hook, exception, "Callback for Bochs `exception` callback")
+        .DEF_GUARDED_RW(BochsCPU::Hook, hw_interrupt, "Callback for Bochs `hw_interrupt` callback")
+        .DEF_GUARDED_RW(BochsCPU::Hook, tlb_cntrl, "Callback for Bochs `tlb_cntrl` callback")
+        .DEF_GUARDED_RW(BochsCPU::Hook, cache_cntrl, "Callback for Bochs `cache_cntrl` callback")
+        .DEF_GUARDED_RW(BochsCPU::Hook, prefetch_hint, "Callback for Bochs `prefetch_hint` callback")
+        .DEF_GUARDED_RW(BochsCPU::Hook, clflush, "Callback for Bochs `clflush` callback")
+        .DEF_GUARDED_RW(BochsCPU::Hook, before_execution, "Callback for Bochs `before_execution` callback")
+        .DEF_GUARDED_RW(BochsCPU::Hook, after_execution, "Callback for Bochs `after_execution` callback")
+        .DEF_GUARDED_RW(BochsCPU::Hook, repeat_iteration, "Callback for Bochs `repeat_iteration` callback")
+        .DEF_GUARDED_RW(BochsCPU::Hook, lin_access, "Callback for Bochs `lin_access` callback")
+        .DEF_GUARDED_RW(BochsCPU::Hook, phy_access, "Callback for Bochs `phy_access` callback")
+        .DEF_GUARDED_RW(BochsCPU::Hook, wrmsr, "Callback for Bochs `wrmsr` callback")
+        .DEF_GUARDED_RW(BochsCPU::Hook, opcode, "Callback for Bochs `opcode` callback")
+        .DEF_GUARDED_RW(BochsCPU::Hook, inp, "Callback for Bochs `inp` callback")
+        .DEF_GUARDED_RW(BochsCPU::Hook, inp2, "Callback for Bochs `inp2` callback")
+        .DEF_GUARDED_RW(BochsCPU::Hook, outp, "Callback for Bochs `outp` callback");
 
     nb::class_<Seg>(m, "Segment", "Segment class")
         .def(nb::init<>())
@@ -332,20 +562,37 @@ NB_MODULE(_bochscpu, m)
         m.def("instr_imm64", &bochscpu_instr_imm64, "p"_a);
     }
 
+    nb::class_<BochsCPU::Snapshot>(m, "Snapshot", "CPU state and guest memory captured by `Session.snapshot()`")
+        .def_ro("state", &BochsCPU::Snapshot::state, "The captured CPU state")
+        .def_prop_ro(
+            "pages",
+            [](BochsCPU::Snapshot const& snap)
+            {
+                std::vector<uint64_t> res;
+                res.reserve(snap.index.size());
+                for ( auto const& [gpa, offset] : snap.index )
+                    res.push_back(gpa);
+                std::sort(res.begin(), res.end());
+                return res;
+            },
+            "Get the GPAs of the captured pages");
+
     nb::class_<BochsCPU::Session>(m, "Session", nb::type_slots(slots), "Class session")
         .def(nb::init<>())
-        .def_rw("missing_page_handler", &BochsCPU::Session::missing_page_handler, "Set the missing page callback")
+        .DEF_GUARDED_RW(BochsCPU::Session, missing_page_handler, "Set the missing page callback")
         .def_ro("cpu", &BochsCPU::Session::cpu, "Get the CPU associated to the session")
         .def(
             "get_auxiliary_variable",
             [](BochsCPU::Session& s, size_t idx)
             {
+                s.CheckNotRunning();
                 return s.auxiliaries.at(idx);
             })
         .def(
             "set_auxiliary_variable",
             [](BochsCPU::Session& s, size_t idx, uint64_t val)
             {
+                s.CheckNotRunning();
                 if ( idx >= BochsCPU::Session::MaxAuxiliaryVariables )
                     throw std::out_of_range(
                         "Invalid range, maximum index is " + std::to_string(BochsCPU::Session::MaxAuxiliaryVariables));
@@ -355,12 +602,14 @@ NB_MODULE(_bochscpu, m)
             "__getitem__",
             [](BochsCPU::Session& s, size_t idx)
             {
+                s.CheckNotRunning();
                 return s.auxiliaries.at(idx);
             })
         .def(
             "__setitem__",
             [](BochsCPU::Session& s, size_t idx, uint64_t val)
             {
+                s.CheckNotRunning();
                 if ( idx >= BochsCPU::Session::MaxAuxiliaryVariables )
                     throw std::out_of_range(
                         "Invalid range, maximum index is " + std::to_string(BochsCPU::Session::MaxAuxiliaryVariables));
@@ -368,68 +617,637 @@ NB_MODULE(_bochscpu, m)
             })
         .def(
             "run",
-            [](BochsCPU::Session& s, std::vector<BochsCPU::Hook>& hook_vector)
-            {
-                if ( hook_vector.size() > MAX_HOOKS )
-                {
-                    throw std::runtime_error("Too many hooks.");
-                }
-
-                bochscpu_hooks_t hooks[MAX_HOOKS + 1] {};
-                bochscpu_hooks_t* hook_chain[MAX_HOOKS + 1] {};
-
-                for ( int i = 0; BochsCPU::Hook & _h : hook_vector )
-                {
-                    //
-                    // Attach a raw session pointer to the Hook context
-                    //
-                    _h.ctx       = (void*)&s;
-                    hooks[i].ctx = (void*)&_h;
-
-                    //
-                    // Set up the callback trampolines
-                    //
-                    hooks[i].after_execution        = BochsCPU::Callbacks::after_execution_cb;
-                    hooks[i].before_execution       = BochsCPU::Callbacks::before_execution_cb;
-                    hooks[i].cache_cntrl            = BochsCPU::Callbacks::cache_cntrl_cb;
-                    hooks[i].clflush                = BochsCPU::Callbacks::clflush_cb;
-                    hooks[i].cnear_branch_not_taken = BochsCPU::Callbacks::cnear_branch_not_taken_cb;
-                    hooks[i].cnear_branch_taken     = BochsCPU::Callbacks::cnear_branch_taken_cb;
-                    hooks[i].exception              = BochsCPU::Callbacks::exception_cb;
-                    hooks[i].far_branch             = BochsCPU::Callbacks::far_branch_cb;
-                    hooks[i].hlt                    = BochsCPU::Callbacks::hlt_cb;
-                    hooks[i].hw_interrupt           = BochsCPU::Callbacks::hw_interrupt_cb;
-                    hooks[i].inp                    = BochsCPU::Callbacks::inp_cb;
-                    hooks[i].inp2                   = BochsCPU::Callbacks::inp2_cb;
-                    hooks[i].interrupt              = BochsCPU::Callbacks::interrupt_cb;
-                    hooks[i].lin_access             = BochsCPU::Callbacks::lin_access_cb;
-                    hooks[i].mwait                  = BochsCPU::Callbacks::mwait_cb;
-                    hooks[i].opcode                 = BochsCPU::Callbacks::opcode_cb;
-                    hooks[i].outp                   = BochsCPU::Callbacks::outp_cb;
-                    hooks[i].phy_access             = BochsCPU::Callbacks::phy_access_cb;
-                    hooks[i].prefetch_hint          = BochsCPU::Callbacks::prefetch_hint_cb;
-                    hooks[i].repeat_iteration       = BochsCPU::Callbacks::repeat_iteration_cb;
-                    hooks[i].reset                  = BochsCPU::Callbacks::reset_cb;
-                    hooks[i].tlb_cntrl              = BochsCPU::Callbacks::tlb_cntrl_cb;
-                    hooks[i].ucnear_branch          = BochsCPU::Callbacks::ucnear_branch_cb;
-                    hooks[i].vmexit                 = BochsCPU::Callbacks::vmexit_cb;
-                    hooks[i].wrmsr                  = BochsCPU::Callbacks::wrmsr_cb;
-
-                    //
-                    // Chain the hook
-                    //
-                    hook_chain[i] = &hooks[i];
-                    i++;
-                }
-
-                ::bochscpu_cpu_run(s.cpu.__cpu, hook_chain);
-            },
-            "Start the execution with a set of hooks")
+            [](BochsCPU::Session& s,
+               std::vector<BochsCPU::Hook*> const& hooks,
+               uint64_t max_instructions,
+               std::optional<uint64_t> until_rip,
+               std::optional<double> timeout) -> uint64_t
+            {
+                return s.Run(hooks, max_instructions, until_rip, timeout);
+            },
+            "hooks"_a            = std::vector<BochsCPU::Hook*> {},
+            "max_instructions"_a = 0,
+            "until_rip"_a        = nb::none(),
+            "timeout"_a          = nb::none(),
+            "Start the execution with the registered hooks, followed by `hooks`. If `max_instructions` is non-zero, "
+            "stop after that many instructions; if `until_rip` is set, stop when that address is reached; if "
+            "`timeout` is set, stop after that many seconds (`stop_reason` is then `StopReason.Timeout`). Returns the "
+            "number of executed instructions. The GIL is released during the execution, and only reacquired to invoke "
+            "Python callbacks. Meanwhile, the session can only be read or changed from those callbacks: other "
+            "threads get a RuntimeError, as does any change of the hook chain, native hooks or running hooks")
         .def(
             "stop",
             [](BochsCPU::Session& s)
             {
-                ::bochscpu_cpu_stop(s.cpu.__cpu);
+                s.Stop(BochsCPU::StopReason::Requested);
+            },
+            "Stop the execution")
+        .def_prop_ro(
+            "executed_instructions",
+            [](BochsCPU::Session const& s)
+            {
+                s.CheckNotRunning();
+                return s.executed_instructions;
+            },
+            "Get the number of instructions executed during the last run")
+        .def_prop_ro(
+            "stop_reason",
+            [](BochsCPU::Session const& s)
+            {
+                return s.stop_reason.load();
+            },
+            "Get the reason why the last run stopped")
+        .def_prop_rw(
+            "breakpoints",
+            [](BochsCPU::Session const& s)
+            {
+                s.CheckNotRunning();
+                return s.breakpoints;
+            },
+            [](BochsCPU::Session& s, std::unordered_set<uint64_t> const& bps)
+            {
+                s.CheckNotRunning();
+                s.breakpoints = bps;
+            },
+            "Get/Set the set of guest RIPs to break on. Breakpoints are checked natively before each instruction, "
+            "so the execution only leaves the emulator when one is hit")
+        .def(
+            "add_breakpoint",
+            [](BochsCPU::Session& s, uint64_t rip)
+            {
+                s.CheckNotRunning();
+                s.breakpoints.insert(rip);
+            },
+            "rip"_a,
+            "Add a breakpoint on the given RIP")
+        .def(
+            "remove_breakpoint",
+            [](BochsCPU::Session& s, uint64_t rip)
+            {
+                s.CheckNotRunning();
+                return s.breakpoints.erase(rip) > 0;
+            },
+            "rip"_a,
+            "Remove the breakpoint on the given RIP, returns True if it existed")
+        .def(
+            "clear_breakpoints",
+            [](BochsCPU::Session& s)
+            {
+                s.CheckNotRunning();
+                s.breakpoints.clear();
+            },
+            "Remove all the breakpoints")
+        .DEF_GUARDED_RW(
+            BochsCPU::Session,
+            breakpoint_handler,
+            "Get/Set the callback invoked with (session, rip) when a breakpoint is hit. If not set, hitting a "
+            "breakpoint stops the execution")
+        .def(
+            "enable_coverage",
+            [](BochsCPU::Session& s, size_t size)
+            {
+                s.CheckNotRunning();
+                if ( !size || (size & (size - 1)) )
+                    throw std::invalid_argument("The coverage map size must be a power of 2");
+
+                //
+                // A map of the same size is only zeroed, so the views handed out so far stay attached
+                //
+                if ( s.coverage && s.coverage->size() == size )
+                    std::fill(s.coverage->begin(), s.coverage->end(), 0);
+                else
+                    s.coverage = std::make_shared<std::vector<uint8_t>>(size, 0);
+            },
+            "size"_a = 0x10000,
+            "Enable the native edge coverage, collected from the branch events into a map of `size` bytes. "
+            "Re-enabling resets the map; if the size changes, the views previously obtained from `coverage` keep the "
+            "old map")
+        .def(
+            "disable_coverage",
+            [](BochsCPU::Session& s)
+            {
+                s.CheckNotRunning();
+                s.coverage.reset();
+            },
+            "Disable the native edge coverage, the views previously obtained from `coverage` keep the last map")
+        .def(
+            "reset_coverage",
+            [](BochsCPU::Session& s)
+            {
+                s.CheckNotRunning();
+                if ( s.coverage )
+                    std::fill(s.coverage->begin(), s.coverage->end(), 0);
+            },
+            "Zero the coverage map")
+        .def_prop_ro(
+            "coverage",
+            [](BochsCPU::Session& s) -> std::optional<nb::ndarray<nb::numpy, uint8_t, nb::ndim<1>>>
+            {
+                if ( !s.coverage )
+                    return std::nullopt;
+
+                //
+                // The view owns a reference to the map, so it outlives a `disable_coverage`
+                //
+                auto* owner = new std::shared_ptr<std::vector<uint8_t>>(s.coverage);
+                nb::capsule deleter(
+                    owner,
+                    [](void* p) noexcept
+                    {
+                        delete reinterpret_cast<std::shared_ptr<std::vector<uint8_t>>*>(p);
+                    });
+                const size_t shape[1] = {s.coverage->size()};
+                return nb::ndarray<nb::numpy, uint8_t, nb::ndim<1>>(s.coverage->data(), 1, shape, deleter);
+            },
+            "Get a zero-copy view of the edge coverage map, as a numpy array of hit counters (saturating at 255), "
+            "or None if the coverage is disabled")
+        .def(
+            "enable_memory_trace",
+            [](BochsCPU::Session& s, size_t capacity)
+            {
+                s.CheckNotRunning();
+                if ( !capacity )
+                    throw std::invalid_argument("The memory trace capacity cannot be 0");
+                s.memory_trace.Reset(capacity);
+                s.memory_trace_dropped = 0;
+            },
+            "capacity"_a = 0x100000,
+            "Enable the native memory access trace: every linear and physical access is recorded as (rip, linear, "
+            "physical, len, rw, access) in a preallocated ring buffer of `capacity` entries (must be a power of 2)")
+        .def(
+            "disable_memory_trace",
+            [](BochsCPU::Session& s)
+            {
+                s.CheckNotRunning();
+                s.memory_trace.Reset(0);
+            },
+            "Disable the native memory access trace, discarding the pending records")
+        .def(
+            "drain_memory_trace",
+            &BochsCPU::Session::DrainMemoryTrace,
+            "Dequeue all the pending records of the memory access trace, as a numpy structured array with the fields "
+            "`rip`, `linear`, `physical`, `len`, `rw` and `access`")
+        .DEF_GUARDED_RW(
+            BochsCPU::Session,
+            memory_trace_handler,
+            "Get/Set the callback invoked with (session, records) every time the memory access trace is full, and "
+            "when the run returns. Without handler, the accesses recorded while the trace is full are dropped")
+        .def_prop_ro(
+            "memory_trace_dropped",
+            [](BochsCPU::Session const& s)
+            {
+                s.CheckNotRunning();
+                return s.memory_trace_dropped;
+            },
+            "Get the number of memory accesses dropped because the trace was full")
+        .def(
+            "enable_block_profile",
+            [](BochsCPU::Session& s, size_t capacity)
+            {
+                s.CheckNotRunning();
+                if ( !capacity )
+                    throw std::invalid_argument("The block profile capacity cannot be 0");
+                s.block_profile.Reset(capacity);
+            },
+            "capacity"_a = 0x10000,
+            "Enable the native basic block profiler: the execution and instruction counts of each block, delimited "
+            "by the branch events, are kept in a hash map of initially `capacity` slots (must be a power of 2)")
+        .def(
+            "disable_block_profile",
+            [](BochsCPU::Session& s)
+            {
+                s.CheckNotRunning();
+                s.block_profile.Reset(0);
+            },
+            "Disable the basic block profiler, discarding its counters")
+        .def(
+            "reset_block_profile",
+            [](BochsCPU::Session& s)
+            {
+                s.CheckNotRunning();
+                s.block_profile.Reset(s.block_profile.Capacity());
+            },
+            "Discard the counters of the basic block profiler")
+        .def_prop_ro(
+            "block_profile",
+            [](BochsCPU::Session& s) -> nb::object
+            {
+                s.CheckNotRunning();
+                if ( !s.block_profile.Capacity() )
+                    return nb::none();
+
+                auto const records = s.block_profile.Records();
+                return BochsCPU::Utils::ToStructuredArray(
+                    records.data(),
+                    records.size(),
+                    sizeof(BochsCPU::BlockRecord),
+                    {
+                        {"address", "<u8", offsetof(BochsCPU::BlockRecord, address)},
+                        {"count", "<u8", offsetof(BochsCPU::BlockRecord, count)},
+                        {"instructions", "<u8", offsetof(BochsCPU::BlockRecord, instructions)},
+                    });
+            },
+            "Get the basic block profile as a numpy structured array with the fields `address`, `count` (number of "
+            "executions) and `instructions` (number of instructions executed in the block), or None if disabled")
+        .def(
+            "top_blocks",
+            [](BochsCPU::Session& s, size_t n)
+            {
+                s.CheckNotRunning();
+                auto records = s.block_profile.Records();
+                n            = std::min(n, records.size());
+                std::partial_sort(
+                    records.begin(),
+                    records.begin() + n,
+                    records.end(),
+                    [](auto const& a, auto const& b)
+                    {
+                        return a.instructions > b.instructions;
+                    });
+
+                std::vector<std::tuple<uint64_t, uint64_t, uint64_t>> res;
+                for ( size_t i = 0; i < n; i++ )
+                    res.emplace_back(records[i].address, records[i].count, records[i].instructions);
+                return res;
+            },
+            "n"_a = 10,
+            "Get the `n` hottest basic blocks, by number of executed instructions, as (address, count, instructions) "
+            "tuples")
+        .def(
+            "enable_shadow_stack",
+            [](BochsCPU::Session& s, size_t max_depth)
+            {
+                s.CheckNotRunning();
+                if ( !max_depth )
+                    throw std::invalid_argument("The shadow stack depth cannot be 0");
+                s.shadow_stack.Reset(max_depth);
+            },
+            "max_depth"_a = BochsCPU::ShadowStack::DefaultMaxDepth,
+            "Enable the native shadow call stack, maintained from the near call and return events. Beyond `max_depth` "
+            "frames, the outermost ones are dropped")
+        .def(
+            "disable_shadow_stack",
+            [](BochsCPU::Session& s)
+            {
+                s.CheckNotRunning();
+                s.shadow_stack.Reset(0);
+            },
+            "Disable the native shadow call stack")
+        .def_prop_ro(
+            "shadow_stack",
+            [](BochsCPU::Session const& s)
+            {
+                s.CheckNotRunning();
+                std::vector<uint64_t> res;
+                auto const& frames = s.shadow_stack.Frames();
+                for ( auto it = frames.rbegin(); it != frames.rend(); it++ )
+                    res.push_back(it->return_address);
+                return res;
+            },
+            "Get the return addresses of the shadow call stack, innermost first")
+        .def_prop_ro(
+            "shadow_stack_frames",
+            [](BochsCPU::Session const& s)
+            {
+                s.CheckNotRunning();
+                std::vector<std::tuple<uint64_t, uint64_t, uint64_t, uint64_t>> res;
+                auto const& frames = s.shadow_stack.Frames();
+                for ( auto it = frames.rbegin(); it != frames.rend(); it++ )
+                    res.emplace_back(it->call_site, it->target, it->return_address, it->stack_pointer);
+                return res;
+            },
+            "Get the frames of the shadow call stack, innermost first, as (call_site, target, return_address, "
+            "stack_pointer) tuples")
+        .def(
+            "enable_function_profile",
+            [](BochsCPU::Session& s)
+            {
+                s.CheckNotRunning();
+                s.function_profiler.Reset(true);
+            },
+            "Enable the native function profiler: the executed instructions are attributed to the guest functions, "
+            "along the call paths built from the near call and return events. Calls deeper than 4096 frames are "
+            "attributed to their caller")
+        .def(
+            "disable_function_profile",
+            [](BochsCPU::Session& s)
+            {
+                s.CheckNotRunning();
+                s.function_profiler.Reset(false);
+            },
+            "Disable the function profiler, discarding its counters")
+        .def(
+            "reset_function_profile",
+            [](BochsCPU::Session& s)
+            {
+                s.CheckNotRunning();
+                s.function_profiler.Reset(s.function_profiler.Enabled());
+            },
+            "Discard the counters of the function profiler")
+        .def_prop_ro(
+            "function_profile",
+            [](BochsCPU::Session const& s)
+            {
+                s.CheckNotRunning();
+                return s.function_profiler.Functions();
+            },
+            "Get the function profile as (address, calls, self, inclusive) tuples, sorted by decreasing inclusive "
+            "instruction count. The entry point of each run counts as a function")
+        .def(
+            "function_profile_folded",
+            [](BochsCPU::Session const& s, std::unordered_map<uint64_t, std::string> const& symbols)
+            {
+                s.CheckNotRunning();
+                return s.function_profiler.Folded(symbols);
+            },
+            "symbols"_a = std::unordered_map<uint64_t, std::string> {},
+            "Export the self instruction counts of the call paths in the folded stacks format of the flamegraph "
+            "tools. Functions are named from the `symbols` dict (address to name), or by their address")
+        .def(
+            "on_syscall",
+            [](BochsCPU::Session& s,
+               uint64_t number,
+               std::function<std::optional<int64_t>(BochsCPU::Session*, uint64_t)> handler)
+            {
+                s.CheckNotRunning();
+                s.syscall_handlers[number] = std::move(handler);
+            },
+            "number"_a,
+            "handler"_a,
+            "Register the handler of the SYSCALL/SYSENTER of the given number (RAX), invoked with (session, number) "
+            "once the instruction executed. If it returns an integer, the syscall is completed natively with that "
+            "value in RAX (negative values for errors, e.g. -errno), back to user mode; if it returns None, the "
+            "execution resumes where the instruction led. The other syscalls are handled natively according to "
+            "`syscall_policy`")
+        .def(
+            "remove_syscall_handler",
+            [](BochsCPU::Session& s, uint64_t number)
+            {
+                s.CheckNotRunning();
+                return s.syscall_handlers.erase(number) > 0;
+            },
+            "number"_a,
+            "Unregister the handler of the given syscall number, returns True if it existed")
+        .DEF_GUARDED_RW(
+            BochsCPU::Session,
+            syscall_policy,
+            "Get/Set what to do natively with the syscalls without handler")
+        .DEF_GUARDED_RW(
+            BochsCPU::Session,
+            syscall_skip_value,
+            "Get/Set the value returned by the syscalls skipped with the `Skip` policy (-ENOSYS by default)")
+        .def_prop_ro(
+            "syscall_counts",
+            [](BochsCPU::Session const& s)
+            {
+                s.CheckNotRunning();
+                return s.syscall_counts;
+            },
+            "Get the number of syscalls counted by the policies other than `Ignore`, as a dict of number to count")
+        .def(
+            "reset_syscall_counts",
+            [](BochsCPU::Session& s)
+            {
+                s.CheckNotRunning();
+                s.syscall_counts.clear();
+            },
+            "Reset the syscall counters")
+        .def(
+            "attach_port_device",
+            &BochsCPU::Session::AttachPortDevice,
+            "first"_a,
+            "last"_a,
+            "device"_a,
+            "Bind a native device to the I/O ports [first, last]: the `in` and `out` instructions on those ports are "
+            "handled without calling Python")
+        .def(
+            "detach_port_device",
+            &BochsCPU::Session::DetachPortDevice,
+            "first"_a,
+            "last"_a,
+            "Unbind the device attached to the ports [first, last], returns True if there was one")
+        .def_prop_ro(
+            "port_devices",
+            [](BochsCPU::Session const& s)
+            {
+                s.CheckNotRunning();
+                return s.port_devices;
+            },
+            "Get the attached port devices, as (first, last, device) tuples")
+        .DEF_GUARDED_RW(
+            BochsCPU::Session,
+            port_read_fallback,
+            "Get/Set the callback invoked with (session, port, len) when the guest reads a port without device with "
+            "`in`. It returns the value to read, or None to keep the one from the emulator. `ins` is left to the "
+            "emulator")
+        .DEF_GUARDED_RW(
+            BochsCPU::Session,
+            port_write_fallback,
+            "Get/Set the callback invoked with (session, port, len, value) when the guest writes a port without "
+            "device")
+        .def(
+            "set_exception_policy",
+            [](BochsCPU::Session& s, uint32_t vector, BochsCPU::ExceptionPolicy policy)
+            {
+                s.CheckNotRunning();
+                if ( vector >= BochsCPU::Session::MaxExceptionVector )
+                    throw std::out_of_range("Invalid exception vector");
+                s.exception_policies[vector] = policy;
+            },
+            "vector"_a,
+            "policy"_a,
+            "Set how the exceptions of the given vector are handled natively, without calling Python")
+        .def(
+            "set_exception_policy",
+            [](BochsCPU::Session& s, BochsCPU::BochsException vector, BochsCPU::ExceptionPolicy policy)
+            {
+                s.CheckNotRunning();
+                s.exception_policies[(uint32_t)vector] = policy;
+            },
+            "vector"_a,
+            "policy"_a,
+            "Set how the exceptions of the given type are handled natively, without calling Python")
+        .def(
+            "get_exception_policy",
+            [](BochsCPU::Session& s, uint32_t vector)
+            {
+                s.CheckNotRunning();
+                return s.exception_policies.at(vector);
+            },
+            "vector"_a,
+            "Get how the exceptions of the given vector are handled natively")
+        .def_prop_ro(
+            "exception_counts",
+            [](BochsCPU::Session const& s)
+            {
+                s.CheckNotRunning();
+                std::unordered_map<uint32_t, uint64_t> res;
+                for ( uint32_t vector = 0; vector < BochsCPU::Session::MaxExceptionVector; vector++ )
+                    if ( s.exception_counts[vector] )
+                        res[vector] = s.exception_counts[vector];
+                return res;
+            },
+            "Get the number of exceptions counted, as a dict of vector to count")
+        .def_prop_ro(
+            "last_exception",
+            [](BochsCPU::Session const& s)
+            {
+                s.CheckNotRunning();
+                return s.last_exception;
+            },
+            "Get the last exception counted as a (vector, error_code, rip, cr2) tuple, or None")
+        .def(
+            "reset_exception_counts",
+            [](BochsCPU::Session& s)
+            {
+                s.CheckNotRunning();
+                s.exception_counts.fill(0);
+                s.last_exception.reset();
+            },
+            "Reset the exception counters and the last exception")
+        .DEF_GUARDED_RW(
+            BochsCPU::Session,
+            exception_handler,
+            "Get/Set the callback invoked with (session, vector, error_code) for the exceptions with the `Python` "
+            "policy")
+        .def(
+            "start_trace",
+            [](BochsCPU::Session& s, std::string const& path, size_t window_size)
+            {
+                s.CheckNotRunning();
+                s.tracer.reset();
+                s.tracer = std::make_unique<BochsCPU::ControlFlowTracer>(path, window_size);
+            },
+            "path"_a,
+            "window_size"_a = BochsCPU::ControlFlowTracer::DefaultWindowSize,
+            "Start recording a compressed control-flow trace (conditional branch outcomes, indirect and far branch "
+            "targets) of the following runs into `path`, mapped `window_size` bytes at a time. The trace can be "
+            "decoded with `bochscpu.utils.trace`")
+        .def(
+            "stop_trace",
+            [](BochsCPU::Session& s) -> uint64_t
+            {
+                s.CheckNotRunning();
+                if ( !s.tracer )
+                    return 0;
+                auto tracer = std::move(s.tracer);
+                tracer->Close();
+                return tracer->Size();
+            },
+            "Stop the control-flow trace and close its file. Returns the size of the trace in bytes. Raises a "
+            "RuntimeError if the trace could not be fully written")
+        .def(
+            "add_hook",
+            &BochsCPU::Session::AddHook,
+            "hook"_a,
+            "priority"_a = 0,
+            "Register a hook in the persistent chain used by every `run`, and return its identifier. Hooks of higher "
+            "priority are invoked first. The chain is only rebuilt when it, or the callbacks of its hooks, change")
+        .def(
+            "remove_hook",
+            &BochsCPU::Session::RemoveHook,
+            "id"_a,
+            "Unregister the hook of the given identifier, returns True if it existed")
+        .def("clear_hooks", &BochsCPU::Session::ClearHooks, "Unregister all the hooks")
+        .def(
+            "load_native_hook",
+            &BochsCPU::Session::LoadNativeHook,
+            "path"_a,
+            "config"_a = "",
+            "Load a native hook plugin (a shared library exporting `bochscpu_plugin_init`, see `bochscpu_plugin.hpp`) "
+            "with the given configuration string, and add it to the hook chain. Returns its identifier")
+        .def(
+            "unload_native_hook",
+            &BochsCPU::Session::UnloadNativeHook,
+            "id"_a,
+            "Remove a native hook plugin from the chain and unload it, returns True if it existed")
+        .def(
+            "allocate_host_page",
+            &BochsCPU::Session::AllocateHostPage,
+            "Allocate a page on the host owned by the session, returns its HVA")
+        .def(
+            "release_host_page",
+            &BochsCPU::Session::ReleaseHostPage,
+            "hva"_a,
+            "Release a host page owned by the session, returns True if it was")
+        .def(
+            "release_host_pages",
+            &BochsCPU::Session::ReleaseHostPages,
+            "Release all the host pages owned by the session, which must not be mapped anymore. Returns how many were "
+            "released")
+        .def_prop_ro(
+            "host_pages",
+            [](BochsCPU::Session const& s)
+            {
+                s.CheckNotRunning();
+                std::vector<uint64_t> res {s.host_pages.begin(), s.host_pages.end()};
+                std::sort(res.begin(), res.end());
+                return res;
+            },
+            "Get the HVAs of the host pages owned by the session")
+        .def(
+            "snapshot",
+            &BochsCPU::Session::TakeSnapshot,
+            "Capture the CPU state and the content of the guest pages mapped through the memory module, and start "
+            "tracking the pages written from then on")
+        .def(
+            "restore",
+            &BochsCPU::Session::RestoreSnapshot,
+            "snapshot"_a,
+            "Restore the CPU state and the guest memory of a snapshot. Only the pages written since the snapshot was "
+            "taken or last restored are copied back, unless another snapshot was taken or restored in the meantime. "
+            "Writes made through `memory.phy_view()` are not tracked. Returns the number of restored pages")
+        .def_prop_ro(
+            "native_hooks",
+            [](BochsCPU::Session const& s)
+            {
+                s.CheckNotRunning();
+                std::vector<std::tuple<uint64_t, std::string, std::string>> res;
+                for ( auto const& n : s.native_hooks )
+                    res.emplace_back(n.id, n.path, n.config);
+                return res;
+            },
+            "Get the loaded native hook plugins, as (id, path, config) tuples")
+        .def_prop_ro(
+            "hooks",
+            [](BochsCPU::Session const& s)
+            {
+                s.CheckNotRunning();
+                std::vector<std::tuple<uint64_t, int32_t, nb::object>> res;
+                for ( auto const& r : s.registered_hooks )
+                    res.emplace_back(r.id, r.priority, r.owner);
+                return res;
+            },
+            "Get the registered hooks in chain order, as (id, priority, hook) tuples")
+        .def(
+            "add_watchpoint",
+            &BochsCPU::Session::AddWatchpoint,
+            "gva_start"_a,
+            "size"_a,
+            "access_type"_a,
+            "Watch the guest linear range [gva_start, gva_start + size) for the given type of access. The accesses "
+            "are checked natively, Python is only involved when a watchpoint is hit")
+        .def(
+            "remove_watchpoint",
+            &BochsCPU::Session::RemoveWatchpoint,
+            "gva_start"_a,
+            "size"_a,
+            "Remove the watchpoints on the given range, returns True if any existed")
+        .def("clear_watchpoints", &BochsCPU::Session::ClearWatchpoints, "Remove all the watchpoints")
+        .def_prop_ro(
+            "watchpoints",
+            [](BochsCPU::Session const& s)
+            {
+                s.CheckNotRunning();
+                std::vector<std::tuple<uint64_t, uint64_t, BochsCPU::Memory::Access>> res;
+                for ( auto const& wp : s.watchpoints )
+                    res.emplace_back(wp.start, wp.end - wp.start, wp.access);
+                return res;
             },
-            "Stop the execution");
+            "Get the list of watchpoints, as (gva_start, size, access_type) tuples")
+        .DEF_GUARDED_RW(
+            BochsCPU::Session,
+            watchpoint_handler,
+            "Get/Set the callback invoked with (session, address, len, access_type) when a watchpoint is hit. If not "
+            "set, hitting a watchpoint stops the execution after the accessing instruction");
 }
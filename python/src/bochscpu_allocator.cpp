@@ -0,0 +1,368 @@
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+#include "bochscpu/bochscpu.hpp"
+#include "bochscpu_allocator.hpp"
+#include "bochscpu_log.hpp"
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif // _WIN32
+
+
+namespace BochsCPU::Memory
+{
+
+uintptr_t
+PageSize()
+{
+    return 0x1000;
+    // TODO: handle 2MB & 1GB pages, see Vol 2 5.1
+}
+
+
+uint64_t
+AlignAddressToPage(uint64_t va)
+{
+    return va & ~0xfff;
+}
+
+
+MappedPages&
+MappedPages::Instance()
+{
+    static MappedPages pages;
+    return pages;
+}
+
+
+void
+MappedPages::Insert(uint64_t gpa, uint8_t* hva)
+{
+    std::lock_guard<std::mutex> lock(m_Lock);
+    m_Pages[AlignAddressToPage(gpa)] = hva;
+
+    //
+    // The content of the page changed as far as the guest is concerned
+    //
+    if ( m_DirtyOwner )
+        m_Dirty.insert(AlignAddressToPage(gpa));
+}
+
+
+void
+MappedPages::Remove(uint64_t gpa)
+{
+    std::lock_guard<std::mutex> lock(m_Lock);
+    m_Pages.erase(AlignAddressToPage(gpa));
+}
+
+
+uint8_t*
+MappedPages::Translate(uint64_t gpa) const
+{
+    std::lock_guard<std::mutex> lock(m_Lock);
+    auto it = m_Pages.find(AlignAddressToPage(gpa));
+    return it != m_Pages.end() ? it->second : nullptr;
+}
+
+
+std::unordered_map<uint64_t, uint8_t*>
+MappedPages::Pages() const
+{
+    std::lock_guard<std::mutex> lock(m_Lock);
+    return m_Pages;
+}
+
+
+void
+MappedPages::TrackDirty(uint64_t owner)
+{
+    std::lock_guard<std::mutex> lock(m_Lock);
+    m_LastDirty  = ~0ULL;
+    m_DirtyOwner = owner;
+    m_Dirty.clear();
+}
+
+
+void
+MappedPages::MarkDirty(uint64_t cr3, uint64_t gva, uint64_t len)
+{
+    if ( !m_DirtyOwner || !len )
+        return;
+
+    const uint64_t last = AlignAddressToPage(gva + len - 1);
+    for ( uint64_t page = AlignAddressToPage(gva); page <= last; page += 0x1000 )
+    {
+        const uint64_t gpa = ::bochscpu_mem_virt_translate(cr3, page);
+        if ( gpa != ~0ULL )
+            MarkDirty(gpa, 1);
+    }
+}
+
+
+std::vector<uint64_t>
+MappedPages::Dirty() const
+{
+    std::lock_guard<std::mutex> lock(m_Lock);
+    return {m_Dirty.begin(), m_Dirty.end()};
+}
+
+
+std::vector<uint64_t>
+MappedPages::TakeDirty()
+{
+    std::lock_guard<std::mutex> lock(m_Lock);
+    m_LastDirty = ~0ULL;
+    std::vector<uint64_t> res {m_Dirty.begin(), m_Dirty.end()};
+    m_Dirty.clear();
+    return res;
+}
+
+
+PageAllocator&
+PageAllocator::Instance()
+{
+    static PageAllocator allocator;
+    return allocator;
+}
+
+
+PageAllocator::Arena*
+PageAllocator::CreateArena()
+{
+    //
+    // Over-reserve to align the arena on its size, so the arena of a page is found from its address alone
+    //
+#if defined(_WIN32)
+    uint8_t* base = nullptr;
+    for ( int attempt = 0; attempt < 8 && !base; attempt++ )
+    {
+        auto reserved = (uint64_t)::VirtualAlloc(nullptr, 2 * ArenaSize, MEM_RESERVE, PAGE_NOACCESS);
+        if ( !reserved )
+            return nullptr;
+        ::VirtualFree((LPVOID)reserved, 0, MEM_RELEASE);
+
+        //
+        // Another thread may grab the range in between, hence the retries
+        //
+        const uint64_t aligned = (reserved + ArenaSize - 1) & ~(ArenaSize - 1);
+        base = (uint8_t*)::VirtualAlloc((LPVOID)aligned, ArenaSize, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    }
+    if ( !base )
+        return nullptr;
+#else
+    auto reserved =
+        (uint8_t*)::mmap(nullptr, 2 * ArenaSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if ( reserved == MAP_FAILED )
+        return nullptr;
+
+    uint8_t* base         = (uint8_t*)(((uint64_t)reserved + ArenaSize - 1) & ~(ArenaSize - 1));
+    const uint64_t before = base - reserved;
+    if ( before )
+        ::munmap(reserved, before);
+    ::munmap(base + ArenaSize, ArenaSize - before);
+#endif // _WIN32
+
+    const uint64_t key = ArenaKey((uint64_t)base);
+    Arena& arena       = m_Arenas[key];
+    arena.base         = (uint64_t)base;
+    m_Available.push_back(key);
+    m_EmptyArenas++;
+    dbg("Created page arena at %p", base);
+    return &arena;
+}
+
+
+void
+PageAllocator::ReleaseArena(Arena* arena)
+{
+#if defined(_WIN32)
+    ::VirtualFree((LPVOID)arena->base, 0, MEM_RELEASE);
+#else
+    ::munmap((void*)arena->base, ArenaSize);
+#endif // _WIN32
+}
+
+
+uint64_t
+PageAllocator::Allocate(void const* owner)
+{
+    std::lock_guard<std::mutex> lock(m_Lock);
+
+    Arena* arena = nullptr;
+    while ( !m_Available.empty() && !arena )
+    {
+        auto it = m_Arenas.find(m_Available.back());
+        if ( it != m_Arenas.end() && it->second.used < PagesPerArena )
+            arena = &it->second;
+        else
+            m_Available.pop_back();
+    }
+
+    if ( !arena && !(arena = CreateArena()) )
+        return 0;
+
+    if ( !arena->used )
+        m_EmptyArenas--;
+
+    uint32_t index = arena->watermark;
+    if ( arena->used < arena->watermark )
+    {
+        //
+        // Reuse the first freed page, it has to be cleared as it was handed out before
+        //
+        for ( uint32_t i = 0; i < arena->allocated.size(); i++ )
+        {
+            if ( ~arena->allocated[i] )
+            {
+                index = i * 64 + std::countr_one(arena->allocated[i]);
+                break;
+            }
+        }
+        ::memset((void*)(arena->base + index * 0x1000ULL), 0, 0x1000);
+    }
+    else
+    {
+        arena->watermark++;
+    }
+
+    arena->allocated[index / 64] |= 1ULL << (index % 64);
+    arena->used++;
+
+    const uint64_t hva = arena->base + index * 0x1000ULL;
+    if ( owner )
+        m_Owners[hva] = owner;
+    return hva;
+}
+
+
+bool
+PageAllocator::Free(uint64_t hva, void const* owner)
+{
+    std::lock_guard<std::mutex> lock(m_Lock);
+    return FreeLocked(hva, owner);
+}
+
+
+size_t
+PageAllocator::Free(std::vector<uint64_t> const& hvas, void const* owner)
+{
+    std::lock_guard<std::mutex> lock(m_Lock);
+
+    size_t released = 0;
+    for ( uint64_t hva : hvas )
+        released += FreeLocked(hva, owner);
+    return released;
+}
+
+
+bool
+PageAllocator::FreeLocked(uint64_t hva, void const* owner)
+{
+    auto it = m_Arenas.find(ArenaKey(hva));
+    if ( it == m_Arenas.end() || (hva & 0xfff) )
+        return false;
+
+    Arena& arena         = it->second;
+    const uint64_t index = (hva - arena.base) / 0x1000;
+    const uint64_t bit   = 1ULL << (index % 64);
+    if ( !(arena.allocated[index / 64] & bit) )
+        return false;
+
+    //
+    // Otherwise the owner would free the page later on, possibly once it was handed out again
+    //
+    auto owned = m_Owners.find(hva);
+    if ( (owned != m_Owners.end() ? owned->second : nullptr) != owner )
+        return false;
+    if ( owned != m_Owners.end() )
+        m_Owners.erase(owned);
+
+    arena.allocated[index / 64] &= ~bit;
+    if ( arena.used-- == PagesPerArena )
+        m_Available.push_back(it->first);
+
+    if ( !arena.used )
+    {
+        if ( m_EmptyArenas )
+        {
+            ReleaseArena(&arena);
+            m_Arenas.erase(it);
+        }
+        else
+        {
+            m_EmptyArenas++;
+        }
+    }
+    return true;
+}
+
+
+uint64_t
+PageAllocator::AllocateRange(uint64_t size)
+{
+    size = (size + 0xfff) & ~0xfffULL;
+    if ( !size )
+        return 0;
+
+#if defined(_WIN32)
+    auto base = (uint64_t)::VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+    auto base = (uint64_t)::mmap(
+        nullptr,
+        size,
+        PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+        -1,
+        0);
+    if ( base == (uint64_t)MAP_FAILED )
+        base = 0;
+#endif // _WIN32
+    if ( !base )
+        return 0;
+
+    std::lock_guard<std::mutex> lock(m_Lock);
+    m_Ranges[base] = size;
+    return base;
+}
+
+
+bool
+PageAllocator::FreeRange(uint64_t hva)
+{
+    uint64_t size = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_Lock);
+        auto it = m_Ranges.find(hva);
+        if ( it == m_Ranges.end() )
+            return false;
+        size = it->second;
+        m_Ranges.erase(it);
+    }
+
+#if defined(_WIN32)
+    return ::VirtualFree((LPVOID)hva, 0, MEM_RELEASE) == TRUE;
+#else
+    return ::munmap((void*)hva, size) == 0;
+#endif // _WIN32
+}
+
+
+std::vector<std::tuple<uint64_t, uint64_t, uint64_t, uint64_t>>
+PageAllocator::Arenas()
+{
+    std::lock_guard<std::mutex> lock(m_Lock);
+
+    std::vector<std::tuple<uint64_t, uint64_t, uint64_t, uint64_t>> res;
+    res.reserve(m_Arenas.size());
+    for ( auto const& [key, arena] : m_Arenas )
+        res.emplace_back(arena.base, PagesPerArena, arena.used, arena.watermark);
+    std::sort(res.begin(), res.end());
+    return res;
+}
+
+} // namespace BochsCPU::Memory
@@ -7,8 +7,8 @@
             err("Context for callback '" #Name "' is unexpectedly null");                                              \
             return;                                                                                                    \
         }                                                                                                              \
-        BochsCPU::Hook* hook    = reinterpret_cast<BochsCPU::Hook*>(Context);                                          \
-        BochsCPU::Session* sess = (BochsCPU::Session*)hook->ctx;                                                       \
+        BochsCPU::Hook* hook    = reinterpret_cast<BochsCPU::HookContext*>(Context)->hook;                             \
+        BochsCPU::Session* sess = reinterpret_cast<BochsCPU::HookContext*>(Context)->session;                          \
         if ( !sess )                                                                                                   \
         {                                                                                                              \
             err("Session for BochsCPU::Hook(%p)->" #Name " is null", hook);                                            \
@@ -16,6 +16,7 @@
         }                                                                                                              \
         if ( hook->Name )                                                                                              \
         {                                                                                                              \
+            nb::gil_scoped_acquire gil;                                                                                \
             hook->Name(sess, __VA_ARGS__);                                                                             \
             return;                                                                                                    \
         }                                                                                                              \
@@ -23,19 +24,47 @@
         return;                                                                                                        \
     }
 
+#define FilterCallback(Context, Address)                                                                               \
+    {                                                                                                                  \
+        BochsCPU::Hook* hook = reinterpret_cast<BochsCPU::HookContext*>(Context)->hook;                                \
+        if ( hook && !hook->ranges.Empty() && !hook->ranges.Contains(Address) )                                        \
+            return;                                                                                                    \
+    }
+
+#define BatchCallback(Context, Event, CpuId)                                                                           \
+    {                                                                                                                  \
+        BochsCPU::HookContext* hc = reinterpret_cast<BochsCPU::HookContext*>(Context);                                 \
+        if ( hc->hook && hc->hook->IsBatched(Event) )                                                                  \
+        {                                                                                                              \
+            hc->hook->RecordBatchEvent(*hc, Event, CpuId);                                                             \
+            return;                                                                                                    \
+        }                                                                                                              \
+    }
+
 namespace BochsCPU::Callbacks
 {
 
+static inline uint64_t
+HookRip(context_t* ctx)
+{
+    BochsCPU::Session* sess = reinterpret_cast<BochsCPU::HookContext*>(ctx)->session;
+    return sess ? ::bochscpu_cpu_rip(sess->cpu.__cpu) : 0;
+}
+
 
 void
 before_execution_cb(context_t* ctx, uint32_t cpu_id, void* insn)
 {
+    FilterCallback(ctx, HookRip(ctx));
+    BatchCallback(ctx, HookEvent::BeforeExecution, cpu_id);
     ExecuteCallback(ctx, before_execution, cpu_id, insn);
 }
 
 void
 after_execution_cb(context_t* ctx, uint32_t cpu_id, void* insn)
 {
+    FilterCallback(ctx, HookRip(ctx));
+    BatchCallback(ctx, HookEvent::AfterExecution, cpu_id);
     ExecuteCallback(ctx, after_execution, cpu_id, insn);
 }
 
@@ -60,18 +89,21 @@ mwait_cb(context_t* ctx, uint32_t cpu_id, uint64_t addr, uintptr_t len, uint32_t
 void
 cnear_branch_taken_cb(context_t* ctx, uint32_t cpu_id, uint64_t branch_eip, uint64_t new_branch_eip)
 {
+    FilterCallback(ctx, branch_eip);
     ExecuteCallback(ctx, cnear_branch_taken, cpu_id, branch_eip, new_branch_eip);
 }
 
 void
 cnear_branch_not_taken_cb(context_t* ctx, uint32_t cpu_id, uint64_t branch_eip, uint64_t new_branch_eip)
 {
+    FilterCallback(ctx, branch_eip);
     ExecuteCallback(ctx, cnear_branch_not_taken, cpu_id, branch_eip, new_branch_eip);
 }
 
 void
 ucnear_branch_cb(context_t* ctx, uint32_t cpu_id, unsigned what, uint64_t branch_eip, uint64_t new_eip)
 {
+    FilterCallback(ctx, branch_eip);
     ExecuteCallback(ctx, ucnear_branch, cpu_id, what, branch_eip, new_eip);
 }
 
@@ -80,12 +112,13 @@ far_branch_cb(
     context_t* ctx,
     uint32_t cpu_id,
     uint32_t what,
+    uint16_t prev_cs,
+    uint64_t prev_eip,
     uint16_t new_cs,
-    uint64_t new_eip,
-    uint16_t cs,
-    uint64_t eip)
+    uint64_t new_eip)
 {
-    ExecuteCallback(ctx, far_branch, cpu_id, what, new_cs, new_eip, cs, eip);
+    FilterCallback(ctx, prev_eip);
+    ExecuteCallback(ctx, far_branch, cpu_id, what, prev_cs, prev_eip, new_cs, new_eip);
 }
 
 void
@@ -140,12 +173,15 @@ wrmsr_cb(context_t* ctx, uint32_t cpu_id, unsigned msr, uint64_t value)
 void
 repeat_iteration_cb(context_t* ctx, uint32_t cpu_id, void* insn)
 {
+    FilterCallback(ctx, HookRip(ctx));
+    BatchCallback(ctx, HookEvent::RepeatIteration, cpu_id);
     ExecuteCallback(ctx, repeat_iteration, cpu_id, insn);
 }
 
 void
 lin_access_cb(context_t* ctx, uint32_t cpu_id, uint64_t lin, uint64_t phy, uintptr_t len, uint32_t rw, uint32_t access)
 {
+    FilterCallback(ctx, lin);
     ExecuteCallback(ctx, lin_access, cpu_id, lin, phy, len, rw, access);
 }
 
@@ -186,4 +222,560 @@ exception_cb(context_t* ctx, uint32_t cpu_id, unsigned vector, unsigned error_co
 }
 
 
-}; // namespace BochsCPU::Callbacks
\ No newline at end of file
+
+namespace Native
+{
+
+///
+/// @brief Check the breakpoints, `until_rip` and the execute watchpoints against the instruction about to run
+///
+/// @return true if the session was stopped in front of it, by itself or by a breakpoint handler
+///
+static bool
+CheckExecutionStops(BochsCPU::Session* sess)
+{
+    //
+    // Don't break again on the instruction the execution is resumed from
+    //
+    if ( sess->resuming )
+    {
+        sess->resuming = false;
+        return false;
+    }
+
+    const bool watch_exec = sess->watchpoint_accesses & (1 << (uint32_t)BochsCPU::Memory::Access::Execute);
+    if ( !sess->until_rip && sess->breakpoints.empty() && !watch_exec )
+        return false;
+
+    const uint64_t rip = ::bochscpu_cpu_rip(sess->cpu.__cpu);
+
+    //
+    // Instruction fetches are not reported as linear accesses, so execute watchpoints are checked here
+    //
+    const bool watch_hit = watch_exec && sess->MayHitWatchpoint(rip, 1) &&
+                           sess->CheckWatchpoints(rip, 1, (uint32_t)BochsCPU::Memory::Access::Execute);
+    if ( watch_hit )
+    {
+        // CheckWatchpoints already stopped the session, or let its handler decide
+    }
+    else if ( sess->until_rip && *sess->until_rip == rip )
+    {
+        dbg("Reached RIP=%#llx", rip);
+        sess->Stop(StopReason::UntilRip);
+    }
+    else if ( sess->breakpoints.contains(rip) )
+    {
+        dbg("Breakpoint hit at RIP=%#llx", rip);
+        if ( sess->breakpoint_handler )
+        {
+            nb::gil_scoped_acquire gil;
+            sess->breakpoint_handler(sess, rip);
+        }
+        else
+        {
+            sess->Stop(StopReason::Breakpoint);
+        }
+    }
+    else
+    {
+        return false;
+    }
+
+    if ( sess->stop_reason.load() == StopReason::Unknown )
+        return false;
+
+    //
+    // Whether stopped by the session or by a handler, the instruction was checked but not executed: the next
+    // run starts from it without checking it again
+    //
+    sess->stopped_at = rip;
+    return true;
+}
+
+void
+before_execution_cb(context_t* ctx, uint32_t cpu_id, void* insn)
+{
+    BochsCPU::Session* sess = reinterpret_cast<BochsCPU::Session*>(ctx);
+
+    if ( sess->pending_exception )
+    {
+        auto const [vector, error_code] = *sess->pending_exception;
+        sess->pending_exception.reset();
+        sess->reinjecting = true;
+        ::bochscpu_cpu_set_exception(sess->cpu.__cpu, vector, error_code);
+    }
+
+    if ( !sess->port_table.empty() || sess->port_read_fallback )
+        sess->instruction_rip = ::bochscpu_cpu_rip(sess->cpu.__cpu);
+
+    if ( CheckExecutionStops(sess) )
+        return;
+
+    //
+    // Only the instructions allowed to execute are counted, so a limit of N runs exactly N of them
+    //
+    if ( sess->max_instructions && sess->executed_instructions >= sess->max_instructions )
+    {
+        dbg("Instruction limit reached (%llu)", sess->executed_instructions);
+        sess->Stop(StopReason::InstructionLimit);
+        return;
+    }
+
+    sess->executed_instructions++;
+}
+
+
+void
+cnear_branch_taken_cb(context_t* ctx, uint32_t cpu_id, uint64_t branch_eip, uint64_t new_branch_eip)
+{
+    BochsCPU::Session* sess = reinterpret_cast<BochsCPU::Session*>(ctx);
+    sess->RecordEdge(branch_eip, new_branch_eip);
+    sess->EnterBlock(new_branch_eip);
+    if ( sess->tracer )
+        sess->tracer->Branch(true);
+}
+
+void
+cnear_branch_not_taken_cb(context_t* ctx, uint32_t cpu_id, uint64_t branch_eip, uint64_t new_branch_eip)
+{
+    BochsCPU::Session* sess = reinterpret_cast<BochsCPU::Session*>(ctx);
+    sess->RecordEdge(branch_eip, new_branch_eip);
+    sess->EnterBlock(new_branch_eip);
+    if ( sess->tracer )
+        sess->tracer->Branch(false);
+}
+
+void
+ucnear_branch_cb(context_t* ctx, uint32_t cpu_id, unsigned what, uint64_t branch_eip, uint64_t new_eip)
+{
+    BochsCPU::Session* sess = reinterpret_cast<BochsCPU::Session*>(ctx);
+    sess->RecordEdge(branch_eip, new_eip);
+    sess->EnterBlock(new_eip);
+
+    if ( !sess->shadow_stack.Enabled() && !sess->function_profiler.Enabled() )
+        return;
+
+    const uint64_t rsp = ::bochscpu_cpu_rsp(sess->cpu.__cpu);
+    if ( what == BOCHSCPU_INSTR_IS_CALL || what == BOCHSCPU_INSTR_IS_CALL_INDIRECT )
+    {
+        uint64_t value {0};
+        ::bochscpu_mem_virt_read(::bochscpu_cpu_cr3(sess->cpu.__cpu), rsp, (uint8_t*)&value, sizeof(value));
+
+        if ( sess->shadow_stack.Enabled() )
+            sess->shadow_stack.Call(branch_eip, new_eip, rsp, value);
+
+        if ( sess->function_profiler.Enabled() )
+            sess->function_profiler.Call(
+                new_eip,
+                ShadowStack::ReturnAddress(branch_eip, value),
+                sess->executed_instructions);
+    }
+    else if ( what == BOCHSCPU_INSTR_IS_RET )
+    {
+        if ( sess->shadow_stack.Enabled() )
+            sess->shadow_stack.Return(new_eip, rsp);
+
+        if ( sess->function_profiler.Enabled() )
+            sess->function_profiler.Return(new_eip, sess->executed_instructions);
+    }
+
+    //
+    // Like Intel PT, the targets of direct jumps and calls are not recorded, they can be recovered from the code
+    //
+    if ( sess->tracer && what != BX_INSTR_IS_JMP && what != BOCHSCPU_INSTR_IS_CALL )
+        sess->tracer->IndirectBranch(new_eip);
+}
+
+void
+far_branch_cb(
+    context_t* ctx,
+    uint32_t cpu_id,
+    uint32_t what,
+    uint16_t prev_cs,
+    uint64_t prev_eip,
+    uint16_t new_cs,
+    uint64_t new_eip)
+{
+    BochsCPU::Session* sess = reinterpret_cast<BochsCPU::Session*>(ctx);
+    sess->RecordEdge(prev_eip, new_eip);
+    sess->EnterBlock(new_eip);
+    if ( sess->tracer )
+        sess->tracer->FarBranch(new_cs, new_eip);
+
+    if ( (what == BOCHSCPU_INSTR_IS_SYSCALL || what == BOCHSCPU_INSTR_IS_SYSENTER) &&
+         (sess->syscall_policy != SyscallPolicy::Ignore || !sess->syscall_handlers.empty()) )
+        sess->DispatchSyscall(what, prev_cs);
+}
+
+void
+lin_access_cb(context_t* ctx, uint32_t cpu_id, uint64_t lin, uint64_t phy, uintptr_t len, uint32_t rw, uint32_t access)
+{
+    BochsCPU::Session* sess = reinterpret_cast<BochsCPU::Session*>(ctx);
+    if ( sess->MayHitWatchpoint(lin, len) )
+        sess->CheckWatchpoints(lin, len, access);
+
+    if ( access == BOCHSCPU_HOOK_MEM_WRITE || access == BOCHSCPU_HOOK_MEM_RW )
+        BochsCPU::Memory::MappedPages::Instance().MarkDirty(phy, len);
+
+    if ( sess->memory_trace.Capacity() )
+    {
+        sess->RecordMemoryAccess(
+            {.rip      = ::bochscpu_cpu_rip(sess->cpu.__cpu),
+             .linear   = lin,
+             .physical = phy,
+             .len      = (uint32_t)len,
+             .rw       = rw,
+             .access   = access});
+    }
+}
+
+void
+phy_access_cb(context_t* ctx, uint32_t cpu_id, uint64_t phy, uintptr_t len, uint32_t rw, uint32_t access)
+{
+    BochsCPU::Session* sess = reinterpret_cast<BochsCPU::Session*>(ctx);
+    if ( access == BOCHSCPU_HOOK_MEM_WRITE || access == BOCHSCPU_HOOK_MEM_RW )
+        BochsCPU::Memory::MappedPages::Instance().MarkDirty(phy, len);
+
+    if ( sess->memory_trace.Capacity() )
+    {
+        sess->RecordMemoryAccess(
+            {.rip      = ::bochscpu_cpu_rip(sess->cpu.__cpu),
+             .linear   = 0,
+             .physical = phy,
+             .len      = (uint32_t)len,
+             .rw       = rw,
+             .access   = access});
+    }
+}
+
+void
+exception_cb(context_t* ctx, uint32_t cpu_id, unsigned vector, unsigned error_code)
+{
+    BochsCPU::Session* sess = reinterpret_cast<BochsCPU::Session*>(ctx);
+    if ( vector >= BochsCPU::Session::MaxExceptionVector )
+        return;
+
+    if ( sess->reinjecting )
+    {
+        sess->reinjecting = false;
+        return;
+    }
+
+    const ExceptionPolicy policy = sess->exception_policies[vector];
+    if ( policy == ExceptionPolicy::Ignore )
+        return;
+
+    sess->exception_counts[vector]++;
+    sess->last_exception = {
+        vector,
+        error_code,
+        ::bochscpu_cpu_rip(sess->cpu.__cpu),
+        ::bochscpu_cpu_cr2(sess->cpu.__cpu)};
+
+    switch ( policy )
+    {
+    case ExceptionPolicy::Stop:
+        dbg("Stopping on exception %u (error_code=%#x)", vector, error_code);
+        sess->Stop(StopReason::Exception);
+        break;
+
+    case ExceptionPolicy::Reinject:
+        sess->pending_exception = {vector, error_code};
+        break;
+
+    case ExceptionPolicy::Python:
+        if ( sess->exception_handler )
+        {
+            nb::gil_scoped_acquire gil;
+            sess->exception_handler(sess, vector, error_code);
+        }
+        break;
+
+    default:
+        break;
+    }
+}
+
+///
+/// @brief Decode the instruction that reads a port: true for `in` (E4/E5/EC/ED), false for `ins` (6C/6D)
+///
+static bool
+IsPortInToRegister(BochsCPU::Session* sess)
+{
+    bochscpu_cpu_state_t state {};
+    ::bochscpu_cpu_state(sess->cpu.__cpu, &state);
+
+    //
+    // 64-bit code ignores the CS base, the other modes fetch from CS.base + IP, translated only when paging
+    //
+    const bool is64 = (state.efer & (1ULL << (uint32_t)BochsCPU::Cpu::FeatureRegisterFlag::LMA)) &&
+                      (state.cs.attr & (1 << (uint32_t)BochsCPU::Cpu::SegmentFlag::L));
+    const bool paging = state.cr0 & (1ULL << (uint32_t)BochsCPU::Cpu::ControlRegisterFlag::PG);
+
+    //
+    // Skip the legacy (and in 64-bit mode, REX) prefixes, up to the maximum instruction length
+    //
+    for ( uint64_t i = 0; i < 15; i++ )
+    {
+        uint64_t linear = sess->instruction_rip + i;
+        if ( !is64 )
+            linear = (state.cs.base + linear) & 0xffffffff;
+
+        const uint64_t gpa = paging ? ::bochscpu_mem_virt_translate(state.cr3, linear) : linear;
+        if ( gpa == ~0ULL )
+            return false;
+
+        uint8_t* page = BochsCPU::Memory::MappedPages::Instance().Translate(gpa);
+        if ( !page )
+            return false;
+
+        const uint8_t byte = page[gpa & 0xfff];
+        switch ( byte )
+        {
+        case 0x26:
+        case 0x2e:
+        case 0x36:
+        case 0x3e:
+        case 0x64:
+        case 0x65:
+        case 0x66:
+        case 0x67:
+        case 0xf0:
+        case 0xf2:
+        case 0xf3:
+            continue;
+
+        case 0xe4:
+        case 0xe5:
+        case 0xec:
+        case 0xed:
+            return true;
+
+        default:
+            if ( is64 && (byte & 0xf0) == 0x40 )
+                continue;
+            return false;
+        }
+    }
+
+    return false;
+}
+
+void
+after_execution_cb(context_t* ctx, uint32_t cpu_id, void* insn)
+{
+    BochsCPU::Session* sess = reinterpret_cast<BochsCPU::Session*>(ctx);
+    if ( !sess->pending_port_input )
+        return;
+
+    auto const [len, value] = *sess->pending_port_input;
+    sess->pending_port_input.reset();
+
+    //
+    // `in` only writes the destination register once the port was read, so patch it now
+    //
+    const uint64_t mask = (len == 1) ? 0xff : (len == 2) ? 0xffff : 0xffffffff;
+    const uint64_t rax  = ::bochscpu_cpu_rax(sess->cpu.__cpu);
+    ::bochscpu_cpu_set_rax(sess->cpu.__cpu, (len == 4) ? value : (rax & ~mask) | (value & mask));
+}
+
+void
+inp2_cb(context_t* ctx, uint16_t port, uintptr_t len, unsigned val)
+{
+    BochsCPU::Session* sess = reinterpret_cast<BochsCPU::Session*>(ctx);
+
+    //
+    // Only `in` can be emulated: `ins` stores the value in memory, and is left to the emulator without reading
+    // the device, which would consume its data
+    //
+    BochsCPU::Devices::PortDevice* device = sess->port_table.empty() ? nullptr : sess->port_table[port];
+    if ( !(device || sess->port_read_fallback) || !IsPortInToRegister(sess) )
+        return;
+
+    if ( device )
+    {
+        sess->pending_port_input = {(uint32_t)len, device->Read(port, len)};
+        return;
+    }
+
+    if ( sess->port_read_fallback )
+    {
+        nb::gil_scoped_acquire gil;
+        auto res = sess->port_read_fallback(sess, port, len);
+        if ( res )
+            sess->pending_port_input = {(uint32_t)len, *res};
+    }
+}
+
+void
+outp_cb(context_t* ctx, uint16_t port, uintptr_t len, unsigned val)
+{
+    BochsCPU::Session* sess = reinterpret_cast<BochsCPU::Session*>(ctx);
+
+    BochsCPU::Devices::PortDevice* device = sess->port_table.empty() ? nullptr : sess->port_table[port];
+    if ( device )
+    {
+        device->Write(port, len, val);
+        return;
+    }
+
+    if ( sess->port_write_fallback )
+    {
+        nb::gil_scoped_acquire gil;
+        sess->port_write_fallback(sess, port, len, val);
+    }
+}
+
+} // namespace Native
+
+}; // namespace BochsCPU::Callbacks
+
+
+namespace BochsCPU
+{
+
+uint32_t
+Hook::EventMask() const
+{
+    uint32_t mask {0};
+#define X(field, name)                                                                                                 \
+    if ( this->field )                                                                                                 \
+        mask |= (1 << (uint32_t)HookEvent::name);
+    BOCHSCPU_FOREACH_HOOK_EVENT(X)
+#undef X
+
+    if ( this->batch_size && this->batch )
+        mask |= (this->batch_events & BatchableEvents);
+
+    return mask;
+}
+
+
+uint32_t
+Hook::Install(bochscpu_hooks_t& hooks, HookContext& context)
+{
+    const uint32_t mask = this->EventMask();
+
+    hooks     = {};
+    hooks.ctx = (void*)&context;
+
+#define X(field, name)                                                                                                 \
+    if ( mask & (1 << (uint32_t)HookEvent::name) )                                                                     \
+        hooks.field = BochsCPU::Callbacks::field##_cb;
+    BOCHSCPU_FOREACH_HOOK_EVENT(X)
+#undef X
+
+    context.batch_records.clear();
+    context.batch_records.reserve(this->batch_size);
+
+    return mask;
+}
+
+
+void
+Hook::RecordBatchEvent(HookContext& context, HookEvent e, uint32_t cpu_id)
+{
+    context.batch_records.push_back(
+        {.rip = ::bochscpu_cpu_rip(context.session->cpu.__cpu), .event = (uint32_t)e, .cpu_id = cpu_id});
+
+    if ( context.batch_records.size() >= batch_size )
+        FlushBatch(context);
+}
+
+
+void
+Hook::FlushBatch(HookContext& context)
+{
+    if ( !batch || context.batch_records.empty() )
+        return;
+
+    nb::gil_scoped_acquire gil;
+
+    auto records = Utils::ToStructuredArray(
+        context.batch_records.data(),
+        context.batch_records.size(),
+        sizeof(BatchRecord),
+        {
+            {"rip", "<u8", offsetof(BatchRecord, rip)},
+            {"event", "<u4", offsetof(BatchRecord, event)},
+            {"cpu_id", "<u4", offsetof(BatchRecord, cpu_id)},
+        });
+    context.batch_records.clear();
+
+    batch(context.session, records);
+}
+
+
+uint32_t
+Session::EventMask() const
+{
+    //
+    // Instructions are always counted natively, which also enforces the run limits and the breakpoints
+    //
+    uint32_t mask {0};
+    mask |= (1 << (uint32_t)HookEvent::BeforeExecution);
+
+    if ( this->coverage || this->tracer || this->block_profile.Capacity() )
+    {
+        mask |= (1 << (uint32_t)HookEvent::CnearBranchTaken);
+        mask |= (1 << (uint32_t)HookEvent::CnearBranchNotTaken);
+        mask |= (1 << (uint32_t)HookEvent::UcnearBranch);
+        mask |= (1 << (uint32_t)HookEvent::FarBranch);
+    }
+
+    if ( this->memory_trace.Capacity() )
+    {
+        mask |= (1 << (uint32_t)HookEvent::LinAccess);
+        mask |= (1 << (uint32_t)HookEvent::PhyAccess);
+    }
+
+    if ( !this->watchpoints.empty() )
+        mask |= (1 << (uint32_t)HookEvent::LinAccess);
+
+    //
+    // Guest writes are reported through either event, depending on the paging mode
+    //
+    if ( Memory::MappedPages::Instance().DirtyOwner() )
+    {
+        mask |= (1 << (uint32_t)HookEvent::LinAccess);
+        mask |= (1 << (uint32_t)HookEvent::PhyAccess);
+    }
+
+    if ( this->HandlesExceptions() )
+        mask |= (1 << (uint32_t)HookEvent::Exception);
+
+    if ( this->HandlesPorts() )
+    {
+        mask |= (1 << (uint32_t)HookEvent::Inp2);
+        mask |= (1 << (uint32_t)HookEvent::Outp);
+        mask |= (1 << (uint32_t)HookEvent::AfterExecution);
+    }
+
+    if ( this->syscall_policy != SyscallPolicy::Ignore || !this->syscall_handlers.empty() )
+        mask |= (1 << (uint32_t)HookEvent::FarBranch);
+
+    if ( this->shadow_stack.Enabled() || this->function_profiler.Enabled() )
+        mask |= (1 << (uint32_t)HookEvent::UcnearBranch);
+
+    return mask;
+}
+
+
+uint32_t
+Session::Install(bochscpu_hooks_t& hooks)
+{
+    const uint32_t mask = this->EventMask();
+
+    hooks     = {};
+    hooks.ctx = (void*)this;
+
+#define X(field, name)                                                                                                 \
+    if ( mask & (1 << (uint32_t)HookEvent::name) )                                                                     \
+        hooks.field = BochsCPU::Callbacks::Native::field##_cb;
+    BOCHSCPU_FOREACH_NATIVE_HOOK_EVENT(X)
+#undef X
+
+    return mask;
+}
+
+} // namespace BochsCPU
\ No newline at end of file
@@ -0,0 +1,128 @@
+#include "bochscpu_devices.hpp"
+
+
+namespace BochsCPU::Devices
+{
+
+namespace
+{
+enum SerialRegister : uint16_t
+{
+    Data              = 0, // RBR/THR, or DLL when DLAB is set
+    InterruptEnable   = 1, // IER, or DLM when DLAB is set
+    InterruptIdentity = 2, // IIR/FCR
+    LineControl       = 3,
+    ModemControl      = 4,
+    LineStatus        = 5,
+    ModemStatus       = 6,
+    Scratch           = 7,
+};
+
+constexpr uint8_t LineControlDlab         = 0x80;
+constexpr uint8_t LineStatusDataReady     = 0x01;
+constexpr uint8_t LineStatusThrEmpty      = 0x20;
+constexpr uint8_t LineStatusTransmitEmpty = 0x40;
+} // namespace
+
+
+uint32_t
+SerialPort::Read(uint16_t port, uint32_t len)
+{
+    std::lock_guard<std::mutex> lock(m_Lock);
+
+    const uint16_t reg = (port - base) & 7;
+    const bool dlab    = m_Registers[LineControl] & LineControlDlab;
+
+    switch ( reg )
+    {
+    case Data:
+        if ( dlab )
+            return m_Divisor[0];
+        if ( m_InputPosition < m_Input.size() )
+            return m_Input[m_InputPosition++];
+        return 0;
+
+    case InterruptEnable:
+        return dlab ? m_Divisor[1] : m_Registers[reg];
+
+    case InterruptIdentity:
+        //
+        // No interrupt pending
+        //
+        return 0x01;
+
+    case LineStatus:
+        return LineStatusThrEmpty | LineStatusTransmitEmpty |
+               (m_InputPosition < m_Input.size() ? LineStatusDataReady : 0);
+
+    case ModemStatus:
+        //
+        // CTS, DSR and DCD asserted
+        //
+        return 0xb0;
+
+    default:
+        return m_Registers[reg];
+    }
+}
+
+
+void
+SerialPort::Write(uint16_t port, uint32_t len, uint32_t value)
+{
+    std::lock_guard<std::mutex> lock(m_Lock);
+
+    const uint16_t reg = (port - base) & 7;
+    const bool dlab    = m_Registers[LineControl] & LineControlDlab;
+
+    switch ( reg )
+    {
+    case Data:
+        if ( dlab )
+            m_Divisor[0] = value & 0xff;
+        else
+            m_Output.push_back(value & 0xff);
+        break;
+
+    case InterruptEnable:
+        if ( dlab )
+            m_Divisor[1] = value & 0xff;
+        else
+            m_Registers[reg] = value & 0xff;
+        break;
+
+    case LineStatus:
+    case ModemStatus:
+        break;
+
+    default:
+        m_Registers[reg] = value & 0xff;
+        break;
+    }
+}
+
+
+std::vector<uint8_t>
+SerialPort::Output() const
+{
+    std::lock_guard<std::mutex> lock(m_Lock);
+    return m_Output;
+}
+
+
+void
+SerialPort::ClearOutput()
+{
+    std::lock_guard<std::mutex> lock(m_Lock);
+    m_Output.clear();
+}
+
+
+void
+SerialPort::Feed(uint8_t const* data, size_t size)
+{
+    std::lock_guard<std::mutex> lock(m_Lock);
+    m_Input.insert(m_Input.end(), data, data + size);
+}
+
+} // namespace BochsCPU::Devices
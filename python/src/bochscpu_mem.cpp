@@ -4,23 +4,15 @@
 #include <nanobind/stl/list.h>
 #include <nanobind/stl/optional.h>
 #include <nanobind/stl/pair.h>
+#include <nanobind/stl/tuple.h>
 #include <nanobind/stl/vector.h>
 
-#include <mutex>
+#include <cstring>
 #include <span>
+#include <tuple>
 
 #include "bochscpu.hpp"
 
-///
-/// @brief Protects `g_GlobalPageAllocation`
-///
-static std::mutex g_GlobalPageMutex;
-
-///
-/// @brief Keep track of the allocated pages on the host so we can deallocate them on exit
-///
-static std::vector<uint64_t> g_GlobalPageAllocation;
-
 namespace nb = nanobind;
 using namespace nb::literals;
 
@@ -45,10 +37,10 @@ bochscpu_memory_module(nb::module_& base_module)
         [](uint64_t gpa, uintptr_t hva)
         {
             dbg("mapping GPA=%#llx <-> HVA=%#llx", gpa, hva);
-            ::bochscpu_mem_page_insert(gpa, (uint8_t*)hva);
+            BochsCPU::Memory::PageInsert(gpa, (uint8_t*)hva);
         },
         "Map a GPA to a HVA");
-    m.def("page_remove", &bochscpu_mem_page_remove, "gpa"_a);
+    m.def("page_remove", &BochsCPU::Memory::PageRemove, "gpa"_a);
     m.def(
         "phy_translate",
         [](const uint64_t gpa)
@@ -59,29 +51,85 @@ bochscpu_memory_module(nb::module_& base_module)
     m.def("virt_translate", &bochscpu_mem_virt_translate, "cr3"_a, "gva"_a);
     m.def(
         "phy_read",
-        [](uint64_t gpa, uintptr_t sz) -> std::vector<uint8_t>
+        [](uint64_t gpa, uintptr_t sz) -> nb::bytes
         {
-            std::vector<uint8_t> hva(sz);
-            ::bochscpu_mem_phy_read(gpa, hva.data(), hva.size());
-            return hva;
+            uint8_t* buf {};
+            nb::bytes res = BochsCPU::Memory::AllocateBytes(sz, buf);
+            ::bochscpu_mem_phy_read(gpa, buf, sz);
+            return res;
         },
         "gpa"_a,
         "size"_a,
         "Read from GPA");
+    m.def(
+        "phy_view",
+        [](uint64_t gpa, uintptr_t sz) -> nb::object
+        {
+            uint8_t* hva = BochsCPU::Memory::PhyTranslateRange(gpa, sz);
+            PyObject* view = ::PyMemoryView_FromMemory((char*)hva, (Py_ssize_t)sz, PyBUF_WRITE);
+            if ( !view )
+                throw nb::python_error();
+            return nb::steal(view);
+        },
+        "gpa"_a,
+        "size"_a,
+        "Get a writable memoryview of the host memory behind [GPA, GPA + size), without copy. The range must be "
+        "backed by contiguous host memory, and the view is only valid while it stays mapped");
+    m.def(
+        "phy_read_into",
+        [](uint64_t gpa, nb::handle out)
+        {
+            BochsCPU::Memory::BufferView view {out, true};
+            ::bochscpu_mem_phy_read(gpa, view.data(), view.size());
+            return view.size();
+        },
+        "gpa"_a,
+        "out"_a,
+        "Read from GPA into a writable contiguous buffer (bytearray, memoryview, numpy array, ...), as much as it "
+        "holds. Returns the number of bytes read");
+    m.def(
+        "phy_write",
+        [](uint64_t gpa, nb::handle bytes)
+        {
+            BochsCPU::Memory::BufferView view {bytes, false};
+            ::bochscpu_mem_phy_write(gpa, view.data(), view.size());
+            BochsCPU::Memory::MappedPages::Instance().MarkDirty(gpa, view.size());
+        },
+        "gpa"_a,
+        "hva"_a,
+        "Write a contiguous buffer (bytes, bytearray, memoryview, numpy array, ...) to GPA");
     m.def(
         "phy_write",
         [](uint64_t gpa, std::vector<uint8_t> const& bytes)
         {
             ::bochscpu_mem_phy_write(gpa, bytes.data(), bytes.size());
+            BochsCPU::Memory::MappedPages::Instance().MarkDirty(gpa, bytes.size());
         },
         "gpa"_a,
         "hva"_a,
         "Write to GPA");
+    m.def(
+        "virt_write",
+        [](uint64_t cr3, uint64_t gva, nb::handle bytes)
+        {
+            BochsCPU::Memory::BufferView view {bytes, false};
+            if ( ::bochscpu_mem_virt_write(cr3, gva, view.data(), view.size()) != 0 )
+                return false;
+            BochsCPU::Memory::MappedPages::Instance().MarkDirty(cr3, gva, view.size());
+            return true;
+        },
+        "cr3"_a,
+        "gva"_a,
+        "bytes"_a,
+        "Write a contiguous buffer (bytes, bytearray, memoryview, numpy array, ...) to GVA");
     m.def(
         "virt_write",
         [](uint64_t cr3, uint64_t gva, std::vector<uint8_t> const& bytes)
         {
-            return ::bochscpu_mem_virt_write(cr3, gva, bytes.data(), bytes.size()) == 0;
+            if ( ::bochscpu_mem_virt_write(cr3, gva, bytes.data(), bytes.size()) != 0 )
+                return false;
+            BochsCPU::Memory::MappedPages::Instance().MarkDirty(cr3, gva, bytes.size());
+            return true;
         },
         "cr3"_a,
         "gva"_a,
@@ -89,19 +137,36 @@ bochscpu_memory_module(nb::module_& base_module)
         "Write to GVA");
     m.def(
         "virt_read",
-        [](uint64_t cr3, uint64_t gva, const uint64_t sz) -> std::vector<uint8_t>
+        [](uint64_t cr3, uint64_t gva, const uint64_t sz) -> nb::bytes
         {
-            std::vector<uint8_t> bytes(sz);
-            if ( ::bochscpu_mem_virt_read(cr3, gva, bytes.data(), bytes.size()) != 0 )
+            uint8_t* buf {};
+            nb::bytes res = BochsCPU::Memory::AllocateBytes(sz, buf);
+            if ( ::bochscpu_mem_virt_read(cr3, gva, buf, sz) != 0 )
             {
                 throw std::runtime_error("Invalid access");
             }
-            return bytes;
+            return res;
         },
         "cr3"_a,
         "gva"_a,
         "sz"_a,
         "Read from GVA");
+    m.def(
+        "virt_read_into",
+        [](uint64_t cr3, uint64_t gva, nb::handle out)
+        {
+            BochsCPU::Memory::BufferView view {out, true};
+            if ( ::bochscpu_mem_virt_read(cr3, gva, view.data(), view.size()) != 0 )
+            {
+                throw std::runtime_error("Invalid access");
+            }
+            return view.size();
+        },
+        "cr3"_a,
+        "gva"_a,
+        "out"_a,
+        "Read from GVA into a writable contiguous buffer (bytearray, memoryview, numpy array, ...), as much as it "
+        "holds. Returns the number of bytes read");
     m.def(
         "allocate_host_page",
         []() -> uint64_t
@@ -114,7 +179,78 @@ bochscpu_memory_module(nb::module_& base_module)
             return addr;
         },
         "Allocate a page on the host, returns the HVA on success, 0 otherwise");
-    m.def("release_host_page", &BochsCPU::Memory::FreePage, "hva"_a, "Release a page on the host");
+    m.def(
+        "release_host_page",
+        &BochsCPU::Memory::FreePage,
+        "hva"_a,
+        "Release a page on the host. Returns False for the pages not allocated by `allocate_host_page`, including "
+        "the ones owned by a session");
+    m.def(
+        "release_host_pages",
+        &BochsCPU::Memory::FreePages,
+        "hvas"_a,
+        "Release pages on the host, returns how many were allocated and got released. The pages owned by a "
+        "session are skipped");
+    m.def(
+        "map_range",
+        [](uint64_t gpa, uint64_t size) -> uint64_t
+        {
+            uint64_t hva = BochsCPU::Memory::PageAllocator::Instance().AllocateRange(size);
+            if ( !hva )
+                throw std::runtime_error("range allocation failed");
+
+            try
+            {
+                BochsCPU::Memory::PageInsertRange(gpa, hva, BochsCPU::Memory::AlignAddressToPage(size + 0xfff));
+            }
+            catch ( ... )
+            {
+                BochsCPU::Memory::PageAllocator::Instance().FreeRange(hva);
+                throw;
+            }
+            return hva;
+        },
+        "gpa"_a,
+        "size"_a,
+        "Allocate a contiguous zeroed host region of `size` bytes (rounded up to the page size), and map it at "
+        "GPA. Returns its HVA, to release with `release_host_range` once unmapped");
+    m.def(
+        "page_insert_range",
+        &BochsCPU::Memory::PageInsertRange,
+        "gpa"_a,
+        "hva"_a,
+        "size"_a,
+        "Map the page-aligned GPA range to the host range starting at HVA");
+    m.def(
+        "page_remove_range",
+        &BochsCPU::Memory::PageRemoveRange,
+        "gpa"_a,
+        "size"_a,
+        "Remove the pages of the page-aligned GPA range");
+    m.def(
+        "release_host_range",
+        [](uint64_t hva)
+        {
+            return BochsCPU::Memory::PageAllocator::Instance().FreeRange(hva);
+        },
+        "hva"_a,
+        "Release a host region allocated by `map_range`");
+    m.def(
+        "dirty_pages",
+        []()
+        {
+            std::vector<uint64_t> res = BochsCPU::Memory::MappedPages::Instance().Dirty();
+            std::sort(res.begin(), res.end());
+            return res;
+        },
+        "Get the GPAs of the pages written since the last `Session.snapshot()` or `Session.restore()`");
+    m.def(
+        "host_page_arenas",
+        []()
+        {
+            return BochsCPU::Memory::PageAllocator::Instance().Arenas();
+        },
+        "Statistics of the host page arenas, as (base, capacity, used, touched) tuples, the last three in pages");
 
     nb::class_<BochsCPU::Memory::PageMapLevel4Table>(m, "PageMapLevel4Table")
         .def(nb::init<>())
@@ -136,58 +272,114 @@ bochscpu_memory_module(nb::module_& base_module)
 namespace BochsCPU::Memory
 {
 
-uintptr_t
-PageSize()
+uint64_t
+AllocatePage()
 {
-    return 0x1000;
-    // TODO: handle 2MB & 1GB pages, see Vol 2 5.1
+    return PageAllocator::Instance().Allocate();
 }
 
 
-uint64_t
-AlignAddressToPage(uint64_t va)
+bool
+FreePage(uint64_t addr)
 {
-    return va & ~0xfff;
+    return PageAllocator::Instance().Free(addr);
 }
 
 
-uint64_t
-AllocatePage()
+size_t
+FreePages(std::vector<uint64_t> const& addrs)
 {
-#if defined(_WIN32)
-    auto addr = (uint64_t)::VirtualAlloc(nullptr, Memory::PageSize(), MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
-#else
-    auto addr =
-        (uint64_t)::mmap(nullptr, Memory::PageSize(), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-#endif // _WIN32
-    if ( addr )
-    {
-        std::lock_guard<std::mutex> scoped_lock(g_GlobalPageMutex);
-        g_GlobalPageAllocation.push_back(addr);
-    }
-    return addr;
+    return PageAllocator::Instance().Free(addrs);
 }
 
 
-bool
-FreePage(uint64_t addr)
+void
+PageInsert(uint64_t gpa, uint8_t* hva)
 {
-#if defined(_WIN32)
-    bool res = ::VirtualFree((LPVOID)addr, 0, MEM_RELEASE) == TRUE;
-#else
-    bool res = ::munmap((void*)addr, Memory::PageSize()) == 0;
-#endif // _WIN32
-    if ( res )
+    ::bochscpu_mem_page_insert(gpa, hva);
+    MappedPages::Instance().Insert(gpa, hva);
+}
+
+
+void
+PageRemove(uint64_t gpa)
+{
+    ::bochscpu_mem_page_remove(gpa);
+    MappedPages::Instance().Remove(gpa);
+}
+
+
+void
+PageInsertRange(uint64_t gpa, uint64_t hva, uint64_t size)
+{
+    if ( (gpa | hva | size) & 0xfff )
+        throw std::invalid_argument("The range must be page-aligned");
+
+    for ( uint64_t off = 0; off < size; off += 0x1000 )
+        PageInsert(gpa + off, (uint8_t*)(hva + off));
+}
+
+
+void
+PageRemoveRange(uint64_t gpa, uint64_t size)
+{
+    if ( (gpa | size) & 0xfff )
+        throw std::invalid_argument("The range must be page-aligned");
+
+    for ( uint64_t off = 0; off < size; off += 0x1000 )
+        PageRemove(gpa + off);
+}
+
+
+nb::bytes
+AllocateBytes(uint64_t size, uint8_t*& buffer)
+{
+    PyObject* obj = ::PyBytes_FromStringAndSize(nullptr, (Py_ssize_t)size);
+    if ( !obj )
+        throw nb::python_error();
+    buffer = (uint8_t*)PyBytes_AS_STRING(obj);
+    return nb::steal<nb::bytes>(obj);
+}
+
+
+uint8_t*
+PhyTranslateRange(uint64_t gpa, uint64_t size)
+{
+    if ( !size )
+        throw std::invalid_argument("The size must be non-zero");
+
+    uint8_t* hva = ::bochscpu_mem_phy_translate(gpa);
+    if ( !hva )
+        throw std::runtime_error("GPA is not mapped");
+
+    //
+    // Every following page must be mapped right after the previous one on the host
+    //
+    for ( uint64_t page = AlignAddressToPage(gpa) + PageSize(); page < gpa + size; page += PageSize() )
     {
-        std::lock_guard<std::mutex> scoped_lock(g_GlobalPageMutex);
-        std::erase_if(
-            g_GlobalPageAllocation,
-            [addr](uint64_t cur_addr)
-            {
-                return cur_addr == addr;
-            });
+        if ( ::bochscpu_mem_phy_translate(page) != hva + (page - gpa) )
+            throw std::runtime_error("The range is not backed by contiguous host memory");
     }
-    return res;
+    return hva;
+}
+
+
+BufferView::BufferView(nb::handle obj, bool writable)
+{
+    //
+    // Objects without the buffer protocol (like lists) are left to the other overloads
+    //
+    if ( !::PyObject_CheckBuffer(obj.ptr()) )
+        throw nb::next_overload();
+
+    if ( ::PyObject_GetBuffer(obj.ptr(), &m_View, writable ? PyBUF_WRITABLE : PyBUF_SIMPLE) < 0 )
+        throw nb::python_error();
+}
+
+
+BufferView::~BufferView()
+{
+    ::PyBuffer_Release(&m_View);
 }
 
 
@@ -198,10 +390,7 @@ FreePage(uint64_t addr)
 
 PageMapLevel4Table::~PageMapLevel4Table()
 {
-    for ( auto addr : m_AllocatedPages )
-    {
-        FreePage(addr);
-    }
+    FreePages(m_AllocatedPages);
 }
 
 std::optional<uint64_t>
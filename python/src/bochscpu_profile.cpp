@@ -0,0 +1,269 @@
+#include <cstdio>
+
+#include "bochscpu_profile.hpp"
+
+
+namespace BochsCPU
+{
+
+void
+FunctionProfiler::Reset(bool enabled)
+{
+    m_Enabled = enabled;
+    m_Nodes.clear();
+    m_Children.clear();
+    m_Stack.clear();
+    m_Current = 0;
+    m_Mark    = 0;
+
+    if ( enabled )
+    {
+        m_Nodes.push_back({});
+        m_Stack.reserve(MaxDepth);
+    }
+}
+
+
+uint32_t
+FunctionProfiler::Child(uint32_t parent, uint64_t function)
+{
+    auto [it, inserted] = m_Children.try_emplace({parent, function}, (uint32_t)m_Nodes.size());
+    if ( inserted )
+        m_Nodes.push_back({.function = function, .parent = parent});
+    return it->second;
+}
+
+
+void
+FunctionProfiler::Begin(uint64_t rip, uint64_t executed_instructions)
+{
+    m_Stack.clear();
+    m_Current = Child(0, rip);
+    m_Nodes[m_Current].calls++;
+    m_Mark = executed_instructions;
+}
+
+
+void
+FunctionProfiler::End(uint64_t executed_instructions)
+{
+    Account(executed_instructions);
+}
+
+
+void
+FunctionProfiler::Call(uint64_t target, uint64_t return_address, uint64_t executed_instructions)
+{
+    //
+    // The call instruction itself belongs to the caller
+    //
+    Account(executed_instructions);
+
+    //
+    // Calls used as jumps (e.g. retpolines, or code that never returns) would otherwise grow the stack and the
+    // call paths forever
+    //
+    if ( m_Stack.size() == MaxDepth )
+        return;
+
+    m_Stack.emplace_back(m_Current, return_address);
+    m_Current = Child(m_Current, target);
+    m_Nodes[m_Current].calls++;
+}
+
+
+void
+FunctionProfiler::Return(uint64_t target, uint64_t executed_instructions)
+{
+    Account(executed_instructions);
+
+    //
+    // Unwind to the frame the return goes back to, possibly skipping some (longjmp). A return to an unknown
+    // address is considered as a jump within the current function.
+    //
+    for ( size_t i = m_Stack.size(); i > 0; i-- )
+    {
+        if ( m_Stack[i - 1].second == target )
+        {
+            m_Current = m_Stack[i - 1].first;
+            m_Stack.resize(i - 1);
+            return;
+        }
+    }
+}
+
+
+std::vector<uint64_t>
+FunctionProfiler::InclusiveInstructions() const
+{
+    //
+    // Children are always created after their parent, so a reverse walk sees every subtree before its root
+    //
+    std::vector<uint64_t> inclusive(m_Nodes.size());
+    for ( size_t i = m_Nodes.size(); i > 1; i-- )
+    {
+        inclusive[i - 1] += m_Nodes[i - 1].self_instructions;
+        inclusive[m_Nodes[i - 1].parent] += inclusive[i - 1];
+    }
+    return inclusive;
+}
+
+
+///
+/// @brief Depth-first walk of the call tree from the root, with an explicit stack so deep paths can't overflow
+/// the native one. `enter` is invoked on each node before its children, `leave` after them.
+///
+template<typename Enter, typename Leave>
+static void
+WalkTree(std::vector<ProfileNode> const& nodes, Enter&& enter, Leave&& leave)
+{
+    if ( nodes.empty() )
+        return;
+
+    //
+    // The children of node `i` are laid out contiguously, in children[first[i], first[i + 1])
+    //
+    std::vector<uint32_t> first(nodes.size() + 1);
+    for ( size_t i = 1; i < nodes.size(); i++ )
+        first[nodes[i].parent + 1]++;
+    for ( size_t i = 0; i < nodes.size(); i++ )
+        first[i + 1] += first[i];
+
+    std::vector<uint32_t> children(nodes.size() - 1);
+    std::vector<uint32_t> next(first.begin(), first.end() - 1);
+    for ( size_t i = 1; i < nodes.size(); i++ )
+        children[next[nodes[i].parent]++] = (uint32_t)i;
+
+    //
+    // Each entry is a node on the current path, and the position of its next child to visit
+    //
+    std::vector<std::pair<uint32_t, uint32_t>> stack;
+    stack.emplace_back(0, first[0]);
+    enter(0);
+    while ( !stack.empty() )
+    {
+        auto& [node, pos] = stack.back();
+        if ( pos == first[node + 1] )
+        {
+            leave(node);
+            stack.pop_back();
+            continue;
+        }
+
+        const uint32_t child = children[pos++];
+        enter(child);
+        stack.emplace_back(child, first[child]);
+    }
+}
+
+
+std::vector<std::tuple<uint64_t, uint64_t, uint64_t, uint64_t>>
+FunctionProfiler::Functions() const
+{
+    const std::vector<uint64_t> inclusive = InclusiveInstructions();
+
+    struct Totals
+    {
+        uint64_t calls {}, self {}, inclusive {};
+
+        ///
+        /// @brief Number of activations of the function on the path being walked
+        ///
+        uint32_t active {};
+    };
+    std::unordered_map<uint64_t, Totals> functions;
+
+    WalkTree(
+        m_Nodes,
+        [&](uint32_t i)
+        {
+            if ( !i )
+                return;
+
+            auto const& node = m_Nodes[i];
+            Totals& totals   = functions[node.function];
+            totals.calls += node.calls;
+            totals.self += node.self_instructions;
+
+            //
+            // Only count the outermost activation of a recursive function in its inclusive count
+            //
+            if ( !totals.active++ )
+                totals.inclusive += inclusive[i];
+        },
+        [&](uint32_t i)
+        {
+            if ( i )
+                functions[m_Nodes[i].function].active--;
+        });
+
+    std::vector<std::tuple<uint64_t, uint64_t, uint64_t, uint64_t>> res;
+    res.reserve(functions.size());
+    for ( auto const& [function, totals] : functions )
+        res.emplace_back(function, totals.calls, totals.self, totals.inclusive);
+
+    std::sort(
+        res.begin(),
+        res.end(),
+        [](auto const& a, auto const& b)
+        {
+            return std::get<3>(a) > std::get<3>(b);
+        });
+    return res;
+}
+
+
+std::string
+FunctionProfiler::Folded(std::unordered_map<uint64_t, std::string> const& symbols) const
+{
+    std::string res;
+
+    //
+    // A single path buffer, extended when entering a node and truncated back when leaving it
+    //
+    std::string path;
+    std::vector<size_t> marks;
+
+    WalkTree(
+        m_Nodes,
+        [&](uint32_t i)
+        {
+            marks.push_back(path.size());
+            if ( !i )
+            {
+                path = "root";
+                return;
+            }
+
+            auto const& node = m_Nodes[i];
+            auto it          = symbols.find(node.function);
+
+            path += ';';
+            if ( it != symbols.end() )
+            {
+                path += it->second;
+            }
+            else
+            {
+                char buf[24];
+                ::snprintf(buf, sizeof(buf), "%#llx", (unsigned long long)node.function);
+                path += buf;
+            }
+
+            if ( node.self_instructions )
+            {
+                res += path;
+                res += ' ';
+                res += std::to_string(node.self_instructions);
+                res += '\n';
+            }
+        },
+        [&](uint32_t)
+        {
+            path.resize(marks.back());
+            marks.pop_back();
+        });
+    return res;
+}
+
+} // namespace BochsCPU
@@ -0,0 +1,930 @@
+#include <nanobind/nanobind.h>
+
+#include <cmath>
+#include <cstring>
+
+#include "bochscpu.hpp"
+
+#if !defined(_WIN32)
+#include <dlfcn.h>
+#endif // _WIN32
+
+namespace nb = nanobind;
+
+
+namespace BochsCPU::Utils
+{
+
+nb::object
+ToStructuredArray(void const* data, size_t count, size_t itemsize, std::initializer_list<FieldDescriptor> fields)
+{
+    nb::module_ np = nb::module_::import_("numpy");
+
+    nb::list names, formats, offsets;
+    for ( auto const& field : fields )
+    {
+        names.append(nb::str(field.name));
+        formats.append(nb::str(field.format));
+        offsets.append(nb::cast(field.offset));
+    }
+
+    nb::dict spec;
+    spec["names"]    = names;
+    spec["formats"]  = formats;
+    spec["offsets"]  = offsets;
+    spec["itemsize"] = nb::cast(itemsize);
+
+    //
+    // Single copy into a bytearray, which numpy then wraps without copying
+    //
+    nb::object buffer = nb::steal(::PyByteArray_FromStringAndSize((const char*)data, count * itemsize));
+    if ( !buffer.is_valid() )
+        throw nb::python_error();
+
+    return np.attr("frombuffer")(buffer, np.attr("dtype")(spec));
+}
+
+} // namespace BochsCPU::Utils
+
+
+namespace BochsCPU
+{
+
+void
+Session::RecordMemoryAccess(MemoryAccessRecord const& record)
+{
+    if ( memory_trace.Push(record) )
+        return;
+
+    if ( !memory_trace_handler )
+    {
+        memory_trace_dropped++;
+        return;
+    }
+
+    FlushMemoryTrace();
+    memory_trace.Push(record);
+}
+
+
+nb::object
+Session::DrainMemoryTrace()
+{
+    CheckNotRunning();
+
+    std::vector<MemoryAccessRecord> records;
+    memory_trace.PopAll(records);
+
+    return Utils::ToStructuredArray(
+        records.data(),
+        records.size(),
+        sizeof(MemoryAccessRecord),
+        {
+            {"rip", "<u8", offsetof(MemoryAccessRecord, rip)},
+            {"linear", "<u8", offsetof(MemoryAccessRecord, linear)},
+            {"physical", "<u8", offsetof(MemoryAccessRecord, physical)},
+            {"len", "<u4", offsetof(MemoryAccessRecord, len)},
+            {"rw", "<u4", offsetof(MemoryAccessRecord, rw)},
+            {"access", "<u4", offsetof(MemoryAccessRecord, access)},
+        });
+}
+
+
+void
+Session::FlushMemoryTrace()
+{
+    if ( !memory_trace_handler || !memory_trace.Size() )
+        return;
+
+    nb::gil_scoped_acquire gil;
+
+    memory_trace_handler(this, DrainMemoryTrace());
+}
+
+
+void
+Session::AddWatchpoint(uint64_t start, uint64_t size, BochsCPU::Memory::Access access)
+{
+    CheckNotRunning();
+
+    if ( !size || start + size < start )
+        throw std::invalid_argument("Invalid watchpoint range");
+
+    watchpoints.push_back({.start = start, .end = start + size, .access = access});
+    RebuildWatchpointFilter();
+}
+
+
+bool
+Session::RemoveWatchpoint(uint64_t start, uint64_t size)
+{
+    CheckNotRunning();
+
+    const size_t count = std::erase_if(
+        watchpoints,
+        [&](Watchpoint const& wp)
+        {
+            return wp.start == start && wp.end == start + size;
+        });
+    RebuildWatchpointFilter();
+    return count > 0;
+}
+
+
+void
+Session::ClearWatchpoints()
+{
+    CheckNotRunning();
+
+    watchpoints.clear();
+    RebuildWatchpointFilter();
+}
+
+
+void
+Session::RebuildWatchpointFilter()
+{
+    watchpoint_accesses = 0;
+    watchpoint_pages.clear();
+    if ( watchpoints.empty() )
+        return;
+
+    watchpoint_pages.assign(WatchpointFilterBits / 64, 0);
+    for ( auto const& wp : watchpoints )
+    {
+        const uint64_t first = wp.start >> 12, last = (wp.end - 1) >> 12;
+        if ( last - first >= WatchpointFilterBits - 1 )
+        {
+            std::fill(watchpoint_pages.begin(), watchpoint_pages.end(), ~0ULL);
+            break;
+        }
+
+        for ( uint64_t page = first; page <= last; page++ )
+        {
+            const uint64_t bit = page & (WatchpointFilterBits - 1);
+            watchpoint_pages[bit / 64] |= 1ULL << (bit % 64);
+        }
+    }
+
+    for ( auto const& wp : watchpoints )
+        watchpoint_accesses |= 1 << (uint32_t)wp.access;
+}
+
+
+bool
+Session::CheckWatchpoints(uint64_t lin, uint64_t len, uint32_t access)
+{
+    //
+    // Bochs read-modify-write accesses (BX_RW) match both the read and write watchpoints
+    //
+    const uint32_t mask = (access == BOCHSCPU_HOOK_MEM_RW) ? (1 << (uint32_t)BochsCPU::Memory::Access::Read) |
+                                                                 (1 << (uint32_t)BochsCPU::Memory::Access::Write) :
+                                                             (1 << access);
+    if ( !(watchpoint_accesses & mask) )
+        return false;
+
+    const uint64_t end = lin + len;
+    for ( auto const& wp : watchpoints )
+    {
+        if ( !(mask & (1 << (uint32_t)wp.access)) || end <= wp.start || wp.end <= lin )
+            continue;
+
+        dbg("Watchpoint hit at %#llx (len=%llu, access=%u)", lin, len, access);
+        if ( watchpoint_handler )
+        {
+            nb::gil_scoped_acquire gil;
+            watchpoint_handler(this, lin, len, wp.access);
+        }
+        else
+        {
+            Stop(StopReason::Watchpoint);
+        }
+        return true;
+    }
+
+    return false;
+}
+
+
+uint64_t
+Session::AddHook(nb::object hook, int32_t priority)
+{
+    CheckStopped();
+
+    Hook* h = nb::cast<Hook*>(hook);
+
+    //
+    // Keep the chain sorted by decreasing priority, after the hooks of same priority
+    //
+    auto it = std::find_if(
+        registered_hooks.begin(),
+        registered_hooks.end(),
+        [priority](RegisteredHook const& r)
+        {
+            return r.priority < priority;
+        });
+
+    const uint64_t id = next_hook_id++;
+    registered_hooks.insert(
+        it,
+        {.id      = id,
+         .priority = priority,
+         .owner    = std::move(hook),
+         .hook     = h,
+         .context  = std::make_shared<HookContext>(HookContext {.session = this, .hook = h})});
+    chain.clear();
+    return id;
+}
+
+
+bool
+Session::RemoveHook(uint64_t id)
+{
+    CheckStopped();
+
+    const size_t count = std::erase_if(
+        registered_hooks,
+        [id](RegisteredHook const& r)
+        {
+            return r.id == id;
+        });
+    if ( count )
+        chain.clear();
+    return count > 0;
+}
+
+
+void
+Session::ClearHooks()
+{
+    CheckStopped();
+
+    registered_hooks.clear();
+    chain.clear();
+}
+
+
+std::vector<bochscpu_hooks_t*> const&
+Session::CompileChain()
+{
+    //
+    // Callbacks can be (un)set on a registered hook at any time, so check that the masks the chain was
+    // compiled with still hold
+    //
+    bool stale = chain.empty() || EventMask() != chain_mask;
+    for ( auto const& r : registered_hooks )
+    {
+        if ( stale )
+            break;
+        stale = r.hook->EventMask() != r.mask;
+    }
+
+    if ( !stale )
+        return chain;
+
+    dbg("Compiling chain of %llu hooks", (uint64_t)registered_hooks.size());
+
+    //
+    // The session native features come first in the chain, then the native plugins, then the hooks that have at
+    // least one callback
+    //
+    chain_hooks.clear();
+    chain_hooks.reserve(registered_hooks.size() + native_hooks.size() + 1);
+    chain_mask = Install(chain_hooks.emplace_back());
+    if ( !chain_mask )
+        chain_hooks.pop_back();
+
+    for ( auto const& n : native_hooks )
+        chain_hooks.push_back(n.hooks);
+
+    for ( auto& r : registered_hooks )
+    {
+        bochscpu_hooks_t hooks {};
+        r.mask = r.hook->Install(hooks, *r.context);
+        if ( r.mask )
+            chain_hooks.push_back(hooks);
+    }
+
+    chain.clear();
+    chain.reserve(chain_hooks.size() + 1);
+    for ( auto& hooks : chain_hooks )
+        chain.push_back(&hooks);
+    chain.push_back(nullptr);
+    return chain;
+}
+
+
+Session::RunningScope::RunningScope(Session& session, std::vector<Hook*> const& extra) : m_Session {session}
+{
+    m_Hooks.reserve(m_Session.registered_hooks.size() + extra.size());
+    for ( auto const& r : m_Session.registered_hooks )
+        m_Hooks.push_back(r.hook);
+    m_Hooks.insert(m_Hooks.end(), extra.begin(), extra.end());
+    for ( Hook* h : m_Hooks )
+        h->running_sessions++;
+
+    m_Session.run_thread = std::this_thread::get_id();
+    m_Session.running    = true;
+}
+
+
+Session::RunningScope::~RunningScope()
+{
+    m_Session.running = false;
+    for ( Hook* h : m_Hooks )
+        h->running_sessions--;
+}
+
+
+uint64_t
+Session::Run(
+    std::vector<Hook*> const& extra,
+    uint64_t max_instructions,
+    std::optional<uint64_t> until_rip,
+    std::optional<double> timeout)
+{
+    if ( running )
+        throw std::runtime_error("The session is already running");
+
+    if ( timeout && !(std::isfinite(*timeout) && *timeout > 0) )
+        throw std::invalid_argument("The timeout must be positive and finite");
+
+    std::vector<bochscpu_hooks_t*> const& compiled = CompileChain();
+    bochscpu_hooks_t** hook_chain                  = const_cast<bochscpu_hooks_t**>(compiled.data());
+
+    //
+    // Hooks only given for this run are appended to a copy of the compiled chain
+    //
+    std::vector<HookContext> extra_contexts;
+    std::vector<bochscpu_hooks_t> extra_hooks;
+    std::vector<bochscpu_hooks_t*> extended_chain;
+    if ( !extra.empty() )
+    {
+        extra_contexts.reserve(extra.size());
+        extra_hooks.reserve(extra.size());
+        for ( Hook* h : extra )
+        {
+            bochscpu_hooks_t hooks {};
+            if ( h->Install(hooks, extra_contexts.emplace_back(HookContext {.session = this, .hook = h})) )
+                extra_hooks.push_back(hooks);
+        }
+
+        extended_chain.assign(compiled.begin(), compiled.end() - 1);
+        for ( auto& hooks : extra_hooks )
+            extended_chain.push_back(&hooks);
+        extended_chain.push_back(nullptr);
+        hook_chain = extended_chain.data();
+    }
+
+    this->max_instructions      = max_instructions;
+    this->until_rip             = until_rip;
+    this->resuming              = stopped_at && *stopped_at == ::bochscpu_cpu_rip(cpu.__cpu);
+    this->stopped_at.reset();
+    this->executed_instructions = 0;
+    this->stop_reason           = StopReason::Unknown;
+    this->pending_port_input.reset();
+    this->pending_exception.reset();
+    this->reinjecting = false;
+
+    if ( tracer )
+        tracer->Begin(::bochscpu_cpu_rip(cpu.__cpu));
+
+    if ( function_profiler.Enabled() )
+        function_profiler.Begin(::bochscpu_cpu_rip(cpu.__cpu), 0);
+
+    if ( block_profile.Capacity() )
+    {
+        current_block      = ::bochscpu_cpu_rip(cpu.__cpu);
+        current_block_mark = 0;
+        block_profile[current_block].count++;
+    }
+
+    //
+    // The GIL is released for the whole emulation, the trampolines only take it back when a Python
+    // callback must be invoked
+    //
+    {
+        RunningScope scope {*this, extra};
+        nb::gil_scoped_release nogil;
+
+        std::optional<Watchdog::ArmedScope> armed;
+        if ( timeout )
+        {
+            if ( !watchdog )
+                watchdog = std::make_unique<Watchdog>(this);
+            armed.emplace(
+                *watchdog,
+                std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                    std::chrono::duration<double>(*timeout)));
+        }
+
+        ::bochscpu_cpu_run(cpu.__cpu, hook_chain);
+
+        //
+        // Disarmed as soon as the CPU returns, so a late deadline can't stop it anymore
+        //
+        armed.reset();
+    }
+
+    if ( function_profiler.Enabled() )
+        function_profiler.End(executed_instructions);
+
+    if ( block_profile.Capacity() )
+    {
+        block_profile[current_block].instructions += executed_instructions - current_block_mark;
+        current_block_mark = executed_instructions;
+    }
+
+    FlushMemoryTrace();
+
+    for ( auto& r : registered_hooks )
+        r.hook->FlushBatch(*r.context);
+
+    for ( auto& c : extra_contexts )
+        c.hook->FlushBatch(c);
+
+    //
+    // Last, as it raises if the trace could not be written
+    //
+    if ( tracer )
+        tracer->End(executed_instructions);
+
+    return executed_instructions;
+}
+
+
+namespace
+{
+
+void*
+OpenModule(std::string const& path)
+{
+#if defined(_WIN32)
+    return (void*)::LoadLibraryA(path.c_str());
+#else
+    return ::dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+#endif // _WIN32
+}
+
+void*
+GetModuleSymbol(void* module, const char* name)
+{
+#if defined(_WIN32)
+    return (void*)::GetProcAddress((HMODULE)module, name);
+#else
+    return ::dlsym(module, name);
+#endif // _WIN32
+}
+
+void
+CloseModule(void* module)
+{
+#if defined(_WIN32)
+    ::FreeLibrary((HMODULE)module);
+#else
+    ::dlclose(module);
+#endif // _WIN32
+}
+
+std::string
+ModuleError()
+{
+#if defined(_WIN32)
+    return "error " + std::to_string(::GetLastError());
+#else
+    const char* msg = ::dlerror();
+    return msg ? msg : "unknown error";
+#endif // _WIN32
+}
+
+} // namespace
+
+
+uint64_t
+Session::LoadNativeHook(std::string const& path, std::string const& config)
+{
+    CheckStopped();
+
+    void* module = OpenModule(path);
+    if ( !module )
+        throw std::runtime_error("Failed to load '" + path + "': " + ModuleError());
+
+    auto init = (bochscpu_plugin_init_t)GetModuleSymbol(module, BOCHSCPU_PLUGIN_INIT_SYMBOL);
+    if ( !init )
+    {
+        CloseModule(module);
+        throw std::runtime_error("'" + path + "' does not export " BOCHSCPU_PLUGIN_INIT_SYMBOL);
+    }
+
+    NativeHook native {
+        .id     = next_hook_id++,
+        .path   = path,
+        .config = config,
+        .module = module,
+        .fini   = (bochscpu_plugin_fini_t)GetModuleSymbol(module, BOCHSCPU_PLUGIN_FINI_SYMBOL),
+    };
+
+    const int res = init(BOCHSCPU_PLUGIN_ABI_VERSION, cpu.__cpu, native.config.c_str(), &native.hooks);
+    if ( res != 0 )
+    {
+        //
+        // The plugin may have allocated its context before failing
+        //
+        if ( native.hooks.ctx && native.fini )
+            native.fini(native.hooks.ctx);
+        CloseModule(module);
+        throw std::runtime_error("Initialization of '" + path + "' failed (" + std::to_string(res) + ")");
+    }
+
+    dbg("Loaded native hook '%s' as #%llu", path.c_str(), native.id);
+    native_hooks.push_back(std::move(native));
+    chain.clear();
+    return native_hooks.back().id;
+}
+
+
+bool
+Session::UnloadNativeHook(uint64_t id)
+{
+    CheckStopped();
+
+    auto it = std::find_if(
+        native_hooks.begin(),
+        native_hooks.end(),
+        [id](NativeHook const& n)
+        {
+            return n.id == id;
+        });
+    if ( it == native_hooks.end() )
+        return false;
+
+    if ( it->fini )
+        it->fini(it->hooks.ctx);
+    CloseModule(it->module);
+
+    native_hooks.erase(it);
+    chain.clear();
+    return true;
+}
+
+
+void
+Session::ClearNativeHooks()
+{
+    while ( !native_hooks.empty() )
+        UnloadNativeHook(native_hooks.back().id);
+}
+
+
+void
+ShadowStack::DiscardDeadFrames(uint64_t stack_pointer, bool inclusive)
+{
+    if ( m_Frames.empty() || stack_pointer < m_Frames.back().stack_pointer ||
+         stack_pointer - m_Frames.back().stack_pointer >= StackPivotThreshold )
+        return;
+
+    while ( !m_Frames.empty() && (m_Frames.back().stack_pointer < stack_pointer ||
+                                  (inclusive && m_Frames.back().stack_pointer == stack_pointer)) )
+        m_Frames.pop_back();
+}
+
+
+void
+ShadowStack::Call(uint64_t call_site, uint64_t target, uint64_t stack_pointer, uint64_t stack_value)
+{
+    const uint64_t return_address = ReturnAddress(call_site, stack_value);
+
+    //
+    // A new return slot at or above a recorded one means that frame is gone (e.g. longjmp)
+    //
+    DiscardDeadFrames(stack_pointer, true);
+
+    if ( m_Frames.size() == m_MaxDepth )
+        m_Frames.erase(m_Frames.begin());
+
+    m_Frames.push_back(
+        {.call_site = call_site, .target = target, .return_address = return_address, .stack_pointer = stack_pointer});
+}
+
+
+void
+ShadowStack::Return(uint64_t target, uint64_t stack_pointer)
+{
+    for ( size_t i = m_Frames.size(); i > 0; i-- )
+    {
+        if ( m_Frames[i - 1].return_address == target )
+        {
+            m_Frames.resize(i - 1);
+            return;
+        }
+    }
+
+    //
+    // Not a return to a recorded frame (ROP, pivot, hand-made return): only drop the frames now below the stack
+    //
+    DiscardDeadFrames(stack_pointer, false);
+}
+
+
+void
+Session::DispatchSyscall(uint32_t what, uint16_t user_cs)
+{
+    const uint64_t number = ::bochscpu_cpu_rax(cpu.__cpu);
+    if ( syscall_policy != SyscallPolicy::Ignore )
+        syscall_counts[number]++;
+
+    auto it = syscall_handlers.find(number);
+    if ( it != syscall_handlers.end() )
+    {
+        std::optional<int64_t> res;
+        {
+            nb::gil_scoped_acquire gil;
+            res = it->second(this, number);
+        }
+
+        if ( res )
+            ReturnFromSyscall(what, user_cs, (uint64_t)*res);
+        return;
+    }
+
+    switch ( syscall_policy )
+    {
+    case SyscallPolicy::Stop:
+        dbg("Stopping on syscall %#llx", number);
+        Stop(StopReason::Syscall);
+        break;
+
+    case SyscallPolicy::Skip:
+        ReturnFromSyscall(what, user_cs, (uint64_t)syscall_skip_value);
+        break;
+
+    default:
+        break;
+    }
+}
+
+
+void
+Session::ReturnFromSyscall(uint32_t what, uint16_t user_cs, uint64_t value)
+{
+    bochscpu_cpu_state_t state {};
+    ::bochscpu_cpu_state(cpu.__cpu, &state);
+
+    //
+    // Mirror the flat segments SYSRET/SYSEXIT load: 64-bit or 32-bit ring 3 code, and ring 3 data
+    //
+    bochscpu_cpu_seg_t cs {}, ss {};
+    cs.present = ss.present = true;
+    cs.limit = ss.limit = 0xffffffff;
+    ss.attr             = 0xc0f3;
+
+    if ( what == BOCHSCPU_INSTR_IS_SYSCALL )
+    {
+        const uint16_t base = (state.star >> 48) & ~3;
+        const bool is_64bit = (user_cs & ~3) == base + 16;
+
+        cs.selector = (is_64bit ? base + 16 : base) | 3;
+        cs.attr     = is_64bit ? 0xa0fb : 0xc0fb;
+        ss.selector = (base + 8) | 3;
+
+        ::bochscpu_cpu_set_rip(cpu.__cpu, state.rcx);
+        ::bochscpu_cpu_set_rflags(cpu.__cpu, (state.r11 & 0x3c7fd7) | 2);
+    }
+    else
+    {
+        const uint16_t base = state.sysenter_cs & ~3;
+        const bool is_64bit = (user_cs & ~3) == base + 32;
+
+        cs.selector = (is_64bit ? base + 32 : base + 16) | 3;
+        cs.attr     = is_64bit ? 0xa0fb : 0xc0fb;
+        ss.selector = (is_64bit ? base + 40 : base + 24) | 3;
+
+        ::bochscpu_cpu_set_rip(cpu.__cpu, state.rdx);
+        ::bochscpu_cpu_set_rsp(cpu.__cpu, state.rcx);
+    }
+
+    ::bochscpu_cpu_set_cs(cpu.__cpu, &cs);
+    ::bochscpu_cpu_set_ss(cpu.__cpu, &ss);
+    ::bochscpu_cpu_set_rax(cpu.__cpu, value);
+}
+
+
+void
+Session::AttachPortDevice(uint16_t first, uint16_t last, std::shared_ptr<Devices::PortDevice> device)
+{
+    CheckNotRunning();
+
+    if ( first > last || !device )
+        throw std::invalid_argument("Invalid port range or device");
+
+    if ( port_table.empty() )
+        port_table.assign(0x10000, nullptr);
+
+    for ( uint32_t port = first; port <= last; port++ )
+        port_table[port] = device.get();
+
+    port_devices.emplace_back(first, last, std::move(device));
+}
+
+
+bool
+Session::DetachPortDevice(uint16_t first, uint16_t last)
+{
+    CheckNotRunning();
+
+    const size_t count = std::erase_if(
+        port_devices,
+        [&](auto const& entry)
+        {
+            return std::get<0>(entry) == first && std::get<1>(entry) == last;
+        });
+    if ( !count )
+        return false;
+
+    //
+    // Rebuild the table, so overlapping ranges attached earlier are visible again
+    //
+    port_table.clear();
+    if ( !port_devices.empty() )
+    {
+        port_table.assign(0x10000, nullptr);
+        for ( auto const& [lo, hi, device] : port_devices )
+            for ( uint32_t port = lo; port <= hi; port++ )
+                port_table[port] = device.get();
+    }
+    return true;
+}
+
+
+uint64_t
+Session::AllocateHostPage()
+{
+    CheckNotRunning();
+
+    uint64_t hva = Memory::PageAllocator::Instance().Allocate(this);
+    if ( !hva )
+        throw std::runtime_error("page allocation failed");
+    host_pages.insert(hva);
+    return hva;
+}
+
+
+bool
+Session::ReleaseHostPage(uint64_t hva)
+{
+    CheckNotRunning();
+
+    if ( !host_pages.erase(hva) )
+        return false;
+    return Memory::PageAllocator::Instance().Free(hva, this);
+}
+
+
+size_t
+Session::ReleaseHostPages()
+{
+    CheckNotRunning();
+
+    const size_t released = Memory::PageAllocator::Instance().Free({host_pages.begin(), host_pages.end()}, this);
+    host_pages.clear();
+    return released;
+}
+
+
+std::shared_ptr<Snapshot>
+Session::TakeSnapshot()
+{
+    CheckNotRunning();
+
+    static std::atomic<uint64_t> next_snapshot_id {1};
+
+    auto const mapped = Memory::MappedPages::Instance().Pages();
+    auto snapshot      = std::make_shared<Snapshot>();
+    snapshot->id       = next_snapshot_id++;
+    ::bochscpu_cpu_state(cpu.__cpu, &snapshot->state);
+
+    snapshot->index.reserve(mapped.size());
+    snapshot->pages.resize(mapped.size() * Memory::PageSize());
+    size_t offset = 0;
+    for ( auto const& [gpa, hva] : mapped )
+    {
+        ::memcpy(snapshot->pages.data() + offset, hva, Memory::PageSize());
+        snapshot->index[gpa] = offset;
+        offset += Memory::PageSize();
+    }
+
+    Memory::MappedPages::Instance().TrackDirty(snapshot->id);
+    dbg("Snapshot #%llu captured %llu pages", snapshot->id, (uint64_t)mapped.size());
+    return snapshot;
+}
+
+
+size_t
+Session::RestoreSnapshot(Snapshot const& snapshot)
+{
+    CheckNotRunning();
+
+    auto& mapped = Memory::MappedPages::Instance();
+    size_t restored {0};
+
+    auto RestorePage = [&](uint64_t gpa, size_t offset)
+    {
+        //
+        // Pages unmapped since the snapshot are left alone
+        //
+        uint8_t* hva = mapped.Translate(gpa);
+        if ( !hva )
+            return;
+        ::memcpy(hva, snapshot.pages.data() + offset, Memory::PageSize());
+        restored++;
+    };
+
+    if ( mapped.DirtyOwner() == snapshot.id )
+    {
+        for ( uint64_t gpa : mapped.TakeDirty() )
+        {
+            auto it = snapshot.index.find(gpa);
+            if ( it != snapshot.index.end() )
+                RestorePage(gpa, it->second);
+        }
+    }
+    else
+    {
+        //
+        // The dirty pages are relative to another snapshot, so everything is copied back
+        //
+        for ( auto const& [gpa, offset] : snapshot.index )
+            RestorePage(gpa, offset);
+        mapped.TrackDirty(snapshot.id);
+    }
+
+    ::bochscpu_cpu_set_state(cpu.__cpu, &snapshot.state);
+    return restored;
+}
+
+
+Watchdog::~Watchdog()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_Lock);
+        m_Quit = true;
+    }
+    m_Cond.notify_all();
+    if ( m_Thread.joinable() )
+        m_Thread.join();
+}
+
+
+void
+Watchdog::Arm(std::chrono::steady_clock::duration timeout)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_Lock);
+        m_Deadline = std::chrono::steady_clock::now() + timeout;
+        m_InRun    = true;
+        if ( !m_Thread.joinable() )
+            m_Thread = std::thread(&Watchdog::Thread, this);
+    }
+    m_Cond.notify_all();
+}
+
+
+void
+Watchdog::Disarm()
+{
+    std::lock_guard<std::mutex> lock(m_Lock);
+    m_Deadline.reset();
+    m_InRun = false;
+}
+
+
+void
+Watchdog::Thread()
+{
+    std::unique_lock<std::mutex> lock(m_Lock);
+
+    while ( !m_Quit )
+    {
+        if ( !m_Deadline )
+        {
+            m_Cond.wait(lock);
+            continue;
+        }
+
+        if ( m_Cond.wait_until(lock, *m_Deadline) == std::cv_status::timeout && m_Deadline &&
+             std::chrono::steady_clock::now() >= *m_Deadline )
+        {
+            //
+            // Still holding the lock, so the run can't complete its `Disarm` in the meantime
+            //
+            m_Deadline.reset();
+            if ( m_InRun )
+            {
+                dbg("Watchdog expired, stopping CPU#%lu", m_Session->cpu.id);
+                m_Session->StopIfUnstopped(StopReason::Timeout);
+            }
+        }
+    }
+}
+
+} // namespace BochsCPU
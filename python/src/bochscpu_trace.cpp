@@ -0,0 +1,350 @@
+#include <cerrno>
+#include <cstring>
+
+#include "bochscpu_log.hpp"
+#include "bochscpu_trace.hpp"
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif // _WIN32
+
+
+namespace BochsCPU
+{
+
+ControlFlowTracer::ControlFlowTracer(std::string const& path, size_t window_size) :
+    m_Path {path},
+    m_WindowSize {window_size}
+{
+    //
+    // Windows can only map views at an allocation granularity (64KB) boundary
+    //
+    if ( !m_WindowSize || (m_WindowSize % 0x10000) )
+        throw std::invalid_argument("The trace window size must be a non-zero multiple of 64KB");
+
+#if defined(_WIN32)
+    m_File = ::CreateFileA(
+        path.c_str(),
+        GENERIC_READ | GENERIC_WRITE,
+        FILE_SHARE_READ,
+        nullptr,
+        CREATE_ALWAYS,
+        FILE_ATTRIBUTE_NORMAL,
+        nullptr);
+    if ( m_File == INVALID_HANDLE_VALUE )
+        throw std::runtime_error("Failed to create '" + path + "'");
+#else
+    m_File = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if ( m_File < 0 )
+        throw std::runtime_error("Failed to create '" + path + "': " + ::strerror(errno));
+#endif // _WIN32
+
+    //
+    // Both windows are mapped upfront, the writer thread then keeps the inactive one ready. The destructor
+    // doesn't run if the constructor throws, so what was mapped and opened so far is released here
+    //
+    try
+    {
+        for ( auto& window : m_Windows )
+        {
+            window.offset = m_NextOffset;
+            window.base   = MapWindow(window.offset);
+            window.ready  = true;
+            m_NextOffset += m_WindowSize;
+        }
+
+        for ( char c : Magic )
+            Emit((uint8_t)c);
+        for ( uint32_t value : {Version, 0u} )
+            for ( int i = 0; i < 4; i++ )
+                Emit((value >> (8 * i)) & 0xff);
+    }
+    catch ( ... )
+    {
+        for ( auto& window : m_Windows )
+        {
+            if ( window.base )
+                UnmapWindow(window.base);
+            window.base = nullptr;
+        }
+#if defined(_WIN32)
+        ::CloseHandle(m_File);
+#else
+        ::close(m_File);
+#endif // _WIN32
+        throw;
+    }
+
+    m_Writer = std::thread(&ControlFlowTracer::WriterThread, this);
+}
+
+
+ControlFlowTracer::~ControlFlowTracer()
+{
+    try
+    {
+        Close();
+    }
+    catch ( std::exception const& e )
+    {
+        warn("Failed to write the trace file '%s': %s", m_Path.c_str(), e.what());
+    }
+}
+
+
+void
+ControlFlowTracer::Begin(uint64_t rip)
+{
+    FlushTnt();
+    Emit((uint8_t)Packet::Start);
+    EmitVarint(rip);
+    m_LastIp = rip;
+}
+
+
+void
+ControlFlowTracer::End(uint64_t executed_instructions)
+{
+    FlushTnt();
+    Emit((uint8_t)Packet::End);
+    EmitVarint(executed_instructions);
+    RaiseWriterError();
+}
+
+
+void
+ControlFlowTracer::IndirectBranch(uint64_t target)
+{
+    FlushTnt();
+    Emit((uint8_t)Packet::Tip);
+    EmitVarint(target ^ m_LastIp);
+    m_LastIp = target;
+}
+
+
+void
+ControlFlowTracer::FarBranch(uint16_t cs, uint64_t target)
+{
+    FlushTnt();
+    Emit((uint8_t)Packet::Far);
+    Emit(cs & 0xff);
+    Emit(cs >> 8);
+    EmitVarint(target ^ m_LastIp);
+    m_LastIp = target;
+}
+
+
+void
+ControlFlowTracer::EmitVarint(uint64_t value)
+{
+    do
+    {
+        uint8_t byte = value & 0x7f;
+        value >>= 7;
+        Emit(byte | (value ? 0x80 : 0));
+    } while ( value );
+}
+
+
+void
+ControlFlowTracer::FlushTnt()
+{
+    if ( !m_TntCount )
+        return;
+
+    //
+    // The stop bit marks how many outcomes the packet holds, bit 0 is always clear for TNT packets
+    //
+    Emit((uint8_t)(((1 << m_TntCount) | m_Tnt) << 1));
+    m_Tnt      = 0;
+    m_TntCount = 0;
+}
+
+
+bool
+ControlFlowTracer::Rotate()
+{
+    if ( m_Failed )
+        return false;
+
+    std::unique_lock<std::mutex> lock(m_Lock);
+
+    const size_t next = m_Active ^ 1;
+    m_Cond.wait(
+        lock,
+        [&]
+        {
+            return (m_Windows[next].ready && !m_Retired) || m_Error;
+        });
+
+    //
+    // This is called from the trampolines, so the error is only raised once the run is over
+    //
+    if ( m_Error )
+    {
+        m_Failed = true;
+        return false;
+    }
+
+    //
+    // Hand the full window over to the writer thread, which unmaps it and maps the next one in its place
+    //
+    m_Windows[m_Active].ready = false;
+    m_Retired                 = m_Active;
+    m_Active                  = next;
+    m_Position                = 0;
+    m_Cond.notify_all();
+    return true;
+}
+
+
+void
+ControlFlowTracer::WriterThread()
+{
+    std::unique_lock<std::mutex> lock(m_Lock);
+
+    while ( true )
+    {
+        m_Cond.wait(
+            lock,
+            [&]
+            {
+                return m_Retired || m_Stopping;
+            });
+
+        if ( !m_Retired )
+            break;
+
+        Window& window = m_Windows[*m_Retired];
+        uint8_t* base  = window.base;
+        uint64_t offset {m_NextOffset};
+        m_NextOffset += m_WindowSize;
+
+        lock.unlock();
+        UnmapWindow(base);
+        uint8_t* next {};
+        try
+        {
+            next = MapWindow(offset);
+        }
+        catch ( ... )
+        {
+            lock.lock();
+            window.base = nullptr;
+            m_Error     = std::current_exception();
+            m_Retired.reset();
+            m_Cond.notify_all();
+            break;
+        }
+        lock.lock();
+
+        window.base   = next;
+        window.offset = offset;
+        window.ready  = true;
+        m_Retired.reset();
+        m_Cond.notify_all();
+    }
+}
+
+
+uint8_t*
+ControlFlowTracer::MapWindow(uint64_t offset)
+{
+    const uint64_t end = offset + m_WindowSize;
+
+#if defined(_WIN32)
+    HANDLE mapping =
+        ::CreateFileMappingA(m_File, nullptr, PAGE_READWRITE, (DWORD)(end >> 32), (DWORD)(end & 0xffffffff), nullptr);
+    if ( !mapping )
+        throw std::runtime_error("CreateFileMapping() failed");
+
+    void* base =
+        ::MapViewOfFile(mapping, FILE_MAP_WRITE, (DWORD)(offset >> 32), (DWORD)(offset & 0xffffffff), m_WindowSize);
+
+    //
+    // The view keeps the mapping alive
+    //
+    ::CloseHandle(mapping);
+    if ( !base )
+        throw std::runtime_error("MapViewOfFile() failed");
+#else
+    if ( ::ftruncate(m_File, end) < 0 )
+        throw std::runtime_error(std::string("ftruncate() failed: ") + ::strerror(errno));
+
+    void* base = ::mmap(nullptr, m_WindowSize, PROT_READ | PROT_WRITE, MAP_SHARED, m_File, offset);
+    if ( base == MAP_FAILED )
+        throw std::runtime_error(std::string("mmap() failed: ") + ::strerror(errno));
+#endif // _WIN32
+
+    dbg("Mapped trace window [%#llx, %#llx) at %p", offset, end, base);
+    return (uint8_t*)base;
+}
+
+
+void
+ControlFlowTracer::UnmapWindow(uint8_t* base)
+{
+#if defined(_WIN32)
+    ::UnmapViewOfFile(base);
+#else
+    ::munmap(base, m_WindowSize);
+#endif // _WIN32
+}
+
+
+void
+ControlFlowTracer::Close()
+{
+    if ( m_Closed )
+        return;
+    m_Closed = true;
+
+    FlushTnt();
+    const uint64_t size = Size();
+
+    {
+        std::lock_guard<std::mutex> lock(m_Lock);
+        m_Stopping = true;
+    }
+    m_Cond.notify_all();
+    m_Writer.join();
+
+    for ( auto& window : m_Windows )
+    {
+        if ( window.base )
+            UnmapWindow(window.base);
+        window.base = nullptr;
+    }
+
+    //
+    // Drop the unused part of the mapped windows
+    //
+#if defined(_WIN32)
+    LARGE_INTEGER li {};
+    li.QuadPart = (LONGLONG)size;
+    ::SetFilePointerEx(m_File, li, nullptr, FILE_BEGIN);
+    ::SetEndOfFile(m_File);
+    ::CloseHandle(m_File);
+    m_File = INVALID_HANDLE_VALUE;
+#else
+    if ( ::ftruncate(m_File, size) < 0 )
+        warn("Failed to truncate the trace file '%s'", m_Path.c_str());
+    ::close(m_File);
+    m_File = -1;
+#endif // _WIN32
+
+    RaiseWriterError();
+}
+
+
+void
+ControlFlowTracer::RaiseWriterError()
+{
+    std::lock_guard<std::mutex> lock(m_Lock);
+    if ( m_Error )
+        std::rethrow_exception(m_Error);
+}
+
+} // namespace BochsCPU